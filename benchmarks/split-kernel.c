@@ -0,0 +1,138 @@
+/*
+  Microbenchmarks of the CCA split kernels
+
+  Built by bench-kernel.R with R CMD SHLIB.  The split rule is compiled
+  into this object from the package sources, so that the kernels are
+  timed exactly as the package builds them but without going through
+  rfsrcGrow().
+
+  benchSplitKernel(n, px, py, balance, reps, kernel) times reps calls of
+  one kernel on a node of n synthetic rows, of which a fraction balance
+  goes to the left daughter, and returns the seconds per call.  The
+  kernels are
+
+    "wrapper"  ccaSplitAbsoluteDifference(), the custom split rule entry
+               point with a workspace of its own,
+    "qr"       ccaSplitPacked(), the QR engine on a packed node,
+    "chol"     ccaSweepSplitStatistic() on LAPACK,
+    "small"    ccaSweepSplitStatistic() on the small-dimension kernels
+               (the same as "chol" when px or py exceeds CCA_SMALL_DIM),
+    "sweep"    a sweep over every split point of the node with the
+               Cholesky engine, updating the cross-product matrices one
+               row at a time, with the time reported per split point.
+*/
+
+#include "../src/splitCustom.c"
+
+#include <string.h>
+#include <time.h>
+
+// The split rules are registered with the forest code, which is not
+// part of this object.
+void registerThis(double (*func) (unsigned int, char *, double *, double *,
+                                  unsigned int, unsigned int, double *,
+                                  double *, double, double, unsigned int,
+                                  double **, unsigned int),
+                  unsigned int family,
+                  unsigned int slot)
+{
+}
+
+static double benchClock(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+}
+
+SEXP benchSplitKernel(SEXP sexp_n,
+                      SEXP sexp_px,
+                      SEXP sexp_py,
+                      SEXP sexp_balance,
+                      SEXP sexp_reps,
+                      SEXP sexp_kernel)
+{
+  unsigned int n  = INTEGER(sexp_n)[0];
+  unsigned int px = INTEGER(sexp_px)[0];
+  unsigned int py = INTEGER(sexp_py)[0];
+  unsigned int dim = px + py;
+  unsigned int leftSize = (unsigned int) (REAL(sexp_balance)[0] * n);
+  int reps = INTEGER(sexp_reps)[0];
+  const char *kernel = CHAR(STRING_ELT(sexp_kernel, 0));
+  double start, elapsed, sink = 0.0;
+  unsigned int i, j, col;
+  int r, info;
+
+  double *packed = (double *) R_alloc((size_t) n * dim, sizeof(double));
+  double **feature = (double **) R_alloc(dim + 2, sizeof(double *));
+  double *totalGram = (double *) R_alloc(dim * dim, sizeof(double));
+  double *leftGram = (double *) R_alloc(dim * dim, sizeof(double));
+  char *membership = (char *) R_alloc(n + 1, sizeof(char));
+
+  GetRNGstate();
+  for (col = 0; col < dim; col++) {
+    for (i = 0; i < n; i++) {
+      packed[i + col * n] = norm_rand() + ((col == 0) || (col == px) ? packed[i] : 0.0);
+    }
+  }
+  PutRNGstate();
+  for (i = 1; i <= n; i++) {
+    membership[i] = (i <= leftSize) ? LEFT : RIGHT;
+  }
+  // The custom split rule takes the features 1-based, with the number
+  // of X variables in feature[dim + 1][1].
+  for (col = 0; col < dim; col++) {
+    feature[col + 1] = packed + col * n - 1;
+  }
+  feature[dim + 1] = (double *) R_alloc(2, sizeof(double));
+  feature[dim + 1][1] = px;
+  for (j = 0; j < dim * dim; j++) totalGram[j] = leftGram[j] = 0.0;
+  for (i = 0; i < n; i++) {
+    ccaUpdateCrossProduct(totalGram, dim, packed + i, n, 1.0);
+    if (i < leftSize) ccaUpdateCrossProduct(leftGram, dim, packed + i, n, 1.0);
+  }
+
+  CCAWorkspace *ws = ccaMakeWorkspace(n, px, py, 0.0);
+  if (strcmp(kernel, "chol") == 0) {
+    ws -> update = ccaUpdateCrossProduct;
+    ws -> correlation = NULL;
+  }
+
+  start = benchClock();
+  if (strcmp(kernel, "wrapper") == 0) {
+    for (r = 0; r < reps; r++) {
+      sink += ccaSplitAbsoluteDifference(n, membership, NULL, NULL, 0, 0, NULL, NULL, 0.0, 0.0, 0, feature, dim + 1);
+    }
+  }
+  else if (strcmp(kernel, "qr") == 0) {
+    for (r = 0; r < reps; r++) {
+      sink += ccaSplitPacked(n, membership, packed, n, px, py, -1.0, ws);
+    }
+  }
+  else if ((strcmp(kernel, "chol") == 0) || (strcmp(kernel, "small") == 0)) {
+    for (r = 0; r < reps; r++) {
+      sink += ccaSweepSplitStatistic(leftSize, n, leftGram, totalGram, px, py, -1.0, ws, &info);
+    }
+  }
+  else if (strcmp(kernel, "sweep") == 0) {
+    for (r = 0; r < reps; r++) {
+      for (j = 0; j < dim * dim; j++) leftGram[j] = 0.0;
+      for (i = 0; i < n - 1; i++) {
+        ws -> update(leftGram, dim, packed + i, n, 1.0);
+        sink += ccaSweepSplitStatistic(i + 1, n, leftGram, totalGram, px, py, -1.0, ws, &info);
+      }
+    }
+    reps *= (n - 1);
+  }
+  else {
+    ccaFreeWorkspace(ws);
+    error("unknown kernel '%s'", kernel);
+  }
+  elapsed = benchClock() - start;
+  ccaFreeWorkspace(ws);
+
+  // Keeps the calls from being optimised away.
+  if (sink == -1.0) Rprintf("%g\n", sink);
+
+  return ScalarReal(elapsed / reps);
+}
@@ -17,13 +17,26 @@
 // >>>>>>>>>> Changes Below >>>>>>>>>> //
 
 /* .Call calls */
+extern SEXP      rfccaBOP(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP rfccaBlasInfo(void);
+extern SEXP rfccaEstimate(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP rfccaEstimateRegularized(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP rfccaEstimateSparse(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP rfccaLeafEstimate(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP rfccaLeafStat(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP rfccaModelMap(SEXP);
+extern SEXP rfccaModelWrite(SEXP, SEXP, SEXP);
+extern SEXP rfccaPermEstimate(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP  rfccaPrepare(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP    rfccaScore(SEXP, SEXP, SEXP);
+extern SEXP     rfccaVimp(SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP   rfsrcCIndex(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP rfsrcDistance(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP     rfsrcGrow(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP,
                           SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP,
                           SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP,
                           SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP,
-                          SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+                          SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP  rfsrcPredict(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP,
                           SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP,
                           SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP,
@@ -32,9 +45,22 @@ extern SEXP  rfsrcPredict(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP,
                           SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 
 static const R_CallMethodDef CallEntries[] = {
+    {"rfccaBOP",      (DL_FUNC) &rfccaBOP,       6},
+    {"rfccaBlasInfo", (DL_FUNC) &rfccaBlasInfo,  0},
+    {"rfccaEstimate", (DL_FUNC) &rfccaEstimate,  7},
+    {"rfccaEstimateRegularized", (DL_FUNC) &rfccaEstimateRegularized,  9},
+    {"rfccaEstimateSparse", (DL_FUNC) &rfccaEstimateSparse,  7},
+    {"rfccaLeafEstimate", (DL_FUNC) &rfccaLeafEstimate, 7},
+    {"rfccaLeafStat", (DL_FUNC) &rfccaLeafStat,  9},
+    {"rfccaModelMap", (DL_FUNC) &rfccaModelMap,  1},
+    {"rfccaModelWrite", (DL_FUNC) &rfccaModelWrite, 3},
+    {"rfccaPermEstimate", (DL_FUNC) &rfccaPermEstimate, 8},
+    {"rfccaPrepare",  (DL_FUNC) &rfccaPrepare,  12},
+    {"rfccaScore",    (DL_FUNC) &rfccaScore,     3},
+    {"rfccaVimp",     (DL_FUNC) &rfccaVimp,      5},
     {"rfsrcCIndex",   (DL_FUNC) &rfsrcCIndex,    6},
     {"rfsrcDistance", (DL_FUNC) &rfsrcDistance,  9},
-    {"rfsrcGrow",     (DL_FUNC) &rfsrcGrow,     46},
+    {"rfsrcGrow",     (DL_FUNC) &rfsrcGrow,     47},
     {"rfsrcPredict",  (DL_FUNC) &rfsrcPredict,  59},
     {NULL, NULL, 0}
 };
@@ -219,6 +219,18 @@ uint      RF_famCCA; /* for rfcca */
 uint      RF_mvdata1Size; /* for rfcca */
 uint      RF_mvdata2Size; /* for rfcca */
 double  **RF_ccaVarIn; /* for rfcca */
+char      RF_ccaSweep; /* for rfcca */
+uint      RF_ccaEngine; /* for rfcca */
+double    RF_ccaTol; /* for rfcca */
+char      RF_ccaPrune; /* for rfcca */
+uint      RF_ccaPermSize; /* for rfcca */
+int      *RF_ccaPermIn; /* for rfcca */
+uint      RF_ccaBins; /* for rfcca */
+int       RF_ccaBlasThreads; /* for rfcca */
+char      RF_ccaProfile; /* for rfcca */
+uint      RF_ccaTreeOffset; /* for rfcca */
+char      RF_ccaPresort; /* for rfcca */
+int       RF_ccaNodeThreads; /* for rfcca */
 double  **RF_responseIn;
 double  **RF_observationIn;
 char     *RF_xType;
@@ -4513,14 +4525,6 @@ void stackShadow (char mode, uint treeID) {
         RF_observation[treeID][p][i] = RF_observationIn[p][i];
       }
     }
-    if(RF_famCCA == 1){
-    RF_ccaVar[treeID] = dmatrix(1, (RF_mvdata1Size + RF_mvdata2Size), 1, RF_observationSize);
-    for (p = 1; p <= (RF_mvdata1Size + RF_mvdata2Size); p++) {
-      for (i = 1; i <= RF_observationSize; i++) {
-        RF_ccaVar[treeID][p][i] = RF_ccaVarIn[p][i];
-      }
-    }
-   }
   }
   else {
     if(RF_mPredictorFlag == TRUE) {
@@ -4536,24 +4540,14 @@ void stackShadow (char mode, uint treeID) {
           }
         }
       }
-        
-      if(RF_famCCA == 1){
-        RF_ccaVar[treeID] = (double **) new_vvector(1, (RF_mvdata1Size + RF_mvdata2Size), NRUTIL_DPTR);
-        for (p = 1; p <= (RF_mvdata1Size + RF_mvdata2Size); p++) {
-          RF_ccaVar[treeID][p] = RF_ccaVarIn[p];
-        }
-        for (p = 1; p <= RF_mpIndexSize; p++) {
-          if (RF_mpIndex[p] > 0) {
-            RF_ccaVar[treeID][(uint) RF_mpIndex[p]] = dvector(1, RF_observationSize);
-            for (i = 1; i <= RF_observationSize; i++) {
-              RF_ccaVar[treeID][(uint) RF_mpIndex[p]][i] = RF_ccaVarIn[(uint) RF_mpIndex[p]][i];
-            }
-          }
-        }
-      }
-        
     }
   }
+  if (RF_famCCA == 1) { /* for rfcca */
+    // The X and Y blocks are never written while growing, neither by the
+    // shadow VIMP nor by the imputation of missing Z, so that all trees
+    // share the incoming block instead of holding a copy each.
+    RF_ccaVar[treeID] = RF_ccaVarIn;
+  }
   if (mode == RF_PRED) {
     if(vimpShadowFlag == TRUE) {
       RF_fobservation[treeID] = dmatrix(1, RF_xSize, 1, RF_fobservationSize);
@@ -4635,9 +4629,6 @@ void unstackShadow (char mode, uint treeID, char respFlag, char covrFlag) {
     }
     if(vimpShadowFlag == TRUE) {
       free_dmatrix(RF_observation[treeID], 1, RF_xSize, 1, RF_observationSize);
-      if(RF_famCCA == 1){
-        free_dmatrix(RF_ccaVar[treeID], 1, (RF_mvdata1Size + RF_mvdata2Size), 1, RF_observationSize);
-      }
     }
     else {
       if(RF_mPredictorFlag == TRUE) {
@@ -4647,14 +4638,6 @@ void unstackShadow (char mode, uint treeID, char respFlag, char covrFlag) {
           }
         }
         free_new_vvector(RF_observation[treeID], 1, RF_xSize, NRUTIL_DPTR);
-        if(RF_famCCA == 1){
-          for (p = 1; p <= RF_mpIndexSize; p++) {
-            if (RF_mpIndex[p] > 0) {
-              free_dvector(RF_ccaVar[treeID][(uint) RF_mpIndex[p]], 1, RF_observationSize);
-            }
-          }
-          free_new_vvector(RF_ccaVar[treeID], 1, (RF_mvdata1Size + RF_mvdata2Size), NRUTIL_DPTR);
-        }
       }
     }
     if (mode == RF_PRED) {
@@ -5097,6 +5080,8 @@ Node *makeNode(unsigned int xSize,
   parent -> allMembrIndx = NULL;
   parent -> repMembrSizeAlloc = parent -> repMembrSize = 0;
   parent -> allMembrSizeAlloc = parent -> allMembrSize = 0;
+  parent -> ccaSortOffset = 0;
+  parent -> ccaStart = NULL;
   return parent;
 }
 void freeNode(Node         *parent) {
@@ -5140,6 +5125,7 @@ void freeNode(Node         *parent) {
       parent -> allMembrIndx = NULL;
     }
   }
+  unstackCCAStart(parent); /* for rfcca */
   free_gblock(parent, (size_t) sizeof(Node));
 }
 void setParent(Node *daughter, Node *parent) {
@@ -6319,6 +6305,18 @@ void lcgenerator(unsigned int *seed, unsigned char reset) {
     *seed = (LCG_IA * (*seed) + LCG_IC) % LCG_IM;
   }
 }
+/* for rfcca */
+// Advances the seed past count draws of the seed of a chain.
+void lcgeneratorSkip(unsigned int *seed, unsigned int count) {
+  unsigned int b;
+  for (b = 1; b <= count; b++) {
+    lcgenerator(seed, FALSE);
+    lcgenerator(seed, FALSE);
+    while(*seed == 0) {
+      lcgenerator(seed, FALSE);
+    }
+  }
+}
 float ran1_original(int *idum) {
   int j;
   int k;
@@ -6787,8 +6785,11 @@ void updateQuantileStream(char     mode,
     }
   }  
 }
+#include     "rfccaThreads.h"
 void rfsrc(char mode, int seedValue) {
   uint   adj;
+  int ccaBlasThreads = 0; /* for rfcca */
+  int ccaMaxActiveLevels = 0; /* for rfcca */
   ulong *mwcpOffset;
   uint previousTreeID;
   uint i, j, k, r;
@@ -6882,6 +6883,28 @@ void rfsrc(char mode, int seedValue) {
   else {
     RF_numThreads = (RF_numThreads < omp_get_max_threads()) ? (RF_numThreads) : (omp_get_max_threads());
   }
+  if ((mode == RF_GROW) && (RF_famCCA == 1)) { /* for rfcca */
+    // Share the threads between the trees and the BLAS calls in their
+    // nodes, and restore the BLAS threads once the forest is grown.
+    ccaBlasThreads = rfccaBlasGetThreads();
+    if (RF_ccaNodeThreads > 1) {
+      // The split search of the large nodes takes the threads left by
+      // the trees in place of BLAS, in a nested team of each tree thread.
+      if (RF_ccaNodeThreads > RF_numThreads) {
+        RF_ccaNodeThreads = RF_numThreads;
+      }
+      RF_numThreads = RF_numThreads / RF_ccaNodeThreads;
+      if (RF_numThreads > (int) RF_ntree) {
+        RF_numThreads = RF_ntree;
+      }
+      rfccaBlasSetThreads(1);
+      ccaMaxActiveLevels = omp_get_max_active_levels();
+      omp_set_max_active_levels(2);
+    }
+    else {
+      rfccaBlasSetThreads(rfccaThreadBudget(&RF_numThreads, RF_ntree, RF_ccaBlasThreads));
+    }
+  }
 #endif
   stackIncomingArrays(mode);
   stackPreDefinedCommonArrays(&RF_nodeMembership,
@@ -6904,6 +6927,10 @@ void rfsrc(char mode, int seedValue) {
   initializeTimeArrays(mode);
   stackFactorArrays(mode);
   stackMissingArrays(mode);
+  stackCCAWorkspace(mode); /* for rfcca */
+  stackCCAPermutation(mode); /* for rfcca */
+  stackCCABins(mode); /* for rfcca */
+  stackCCAPresort(mode); /* for rfcca */
   if (RF_statusIndex > 0) {
     stackCompetingArrays(mode);
   }
@@ -7036,6 +7063,9 @@ void rfsrc(char mode, int seedValue) {
   if (mode == RF_GROW) {
     seedValueLC = abs(seedValue);
     lcgenerator(&seedValueLC, TRUE);
+    // The trees of an extended forest continue the seed stream of the
+    // RF_ccaTreeOffset trees they extend, each of which drew three seeds.
+    lcgeneratorSkip(&seedValueLC, 3 * RF_ccaTreeOffset); /* for rfcca */
     for (b = 1; b <= RF_ntree; b++) {
       lcgenerator(&seedValueLC, FALSE);
       lcgenerator(&seedValueLC, FALSE);
@@ -7076,6 +7106,9 @@ void rfsrc(char mode, int seedValue) {
   if (mode == RF_GROW) {
     seedValueLC = abs(seedValue);
     lcgenerator(&seedValueLC, TRUE);
+    // The trees share the chains here, and the skip only moves an
+    // extended forest off the seeds of the forest it extends.
+    lcgeneratorSkip(&seedValueLC, 3 * RF_ccaTreeOffset); /* for rfcca */
     lcgenerator(&seedValueLC, FALSE);
     lcgenerator(&seedValueLC, FALSE);
     while(seedValueLC == 0) {
@@ -7376,6 +7409,10 @@ void rfsrc(char mode, int seedValue) {
   if (RF_rFactorCount > 0) {
     unstackClassificationArrays(mode);
   }
+  unstackCCAPresort(mode); /* for rfcca */
+  unstackCCABins(mode); /* for rfcca */
+  unstackCCAPermutation(mode); /* for rfcca */
+  unstackCCAWorkspace(mode); /* for rfcca */
   unstackMissingArrays(mode);
   switch (mode) {
   case RF_PRED:
@@ -7402,6 +7439,14 @@ void rfsrc(char mode, int seedValue) {
   randomUnstack(1, 1);
 #endif
   unstackFactorArrays(mode);
+  if (ccaBlasThreads > 0) { /* for rfcca */
+    rfccaBlasSetThreads(ccaBlasThreads);
+  }
+#ifdef _OPENMP
+  if (ccaMaxActiveLevels > 0) { /* for rfcca */
+    omp_set_max_active_levels(ccaMaxActiveLevels);
+  }
+#endif
 }
 void updateTerminalNodeOutcomes(char       mode,
                                 uint       treeID,
@@ -8431,6 +8476,606 @@ uint sampleUniformlyFromVector (uint    treeID,
   return result;
 }
 #include     "splitCustom.h"
+CCAWorkspace **RF_ccaWorkspace; /* for rfcca */
+double         RF_ccaProfileSum[CCA_PROF_CNT]; /* for rfcca */
+void stackCCAWorkspace(char mode) { /* for rfcca */
+  uint i;
+  uint threadCount, size, dimY;
+  RF_ccaWorkspace = NULL;
+  for (i = 0; i < CCA_PROF_CNT; i++) {
+    RF_ccaProfileSum[i] = 0.0;
+  }
+  // Without the CCA family the split rule reads the X block and the
+  // covariates that follow it, and the workspaces are sized for these.
+  dimY = RF_mvdata2Size;
+  if (RF_famCCA != 1) {
+    dimY = (RF_xSize > RF_mvdata1Size) ? (RF_xSize - RF_mvdata1Size) : 0;
+  }
+  if ((mode == RF_GROW) && (RF_mvdata1Size > 0) && (dimY > 0)) {
+    threadCount = 1;
+#ifdef _OPENMP
+    threadCount = RF_numThreads * RF_ccaNodeThreads;
+#endif
+    size = (RF_bootstrapSize > RF_observationSize) ? RF_bootstrapSize : RF_observationSize;
+    RF_ccaWorkspace = (CCAWorkspace **) new_vvector(1, threadCount, NRUTIL_VPTR);
+    for (i = 1; i <= threadCount; i++) {
+      RF_ccaWorkspace[i] = ccaMakeWorkspace(size, RF_mvdata1Size, dimY, RF_ccaTol);
+      RF_ccaWorkspace[i] -> profiling = RF_ccaProfile;
+    }
+  }
+}
+void unstackCCAWorkspace(char mode) { /* for rfcca */
+  uint i, p;
+  uint threadCount;
+  if (RF_ccaWorkspace != NULL) {
+    threadCount = 1;
+#ifdef _OPENMP
+    threadCount = RF_numThreads * RF_ccaNodeThreads;
+#endif
+    for (i = 1; i <= threadCount; i++) {
+      // The profiles of the threads are summed before they go.
+      for (p = 0; p < CCA_PROF_CNT; p++) {
+        RF_ccaProfileSum[p] += RF_ccaWorkspace[i] -> profile[p];
+      }
+      ccaFreeWorkspace(RF_ccaWorkspace[i]);
+    }
+    free_new_vvector(RF_ccaWorkspace, 1, threadCount, NRUTIL_VPTR);
+    RF_ccaWorkspace = NULL;
+  }
+}
+double ***RF_ccaPermObservation; /* for rfcca */
+void stackCCAPermutation(char mode) { /* for rfcca */
+  uint p, v, i, b;
+  uint treePerPerm;
+  RF_ccaPermObservation = NULL;
+  if ((mode == RF_GROW) && (RF_ccaPermSize > 0)) {
+    if ((RF_ntree % RF_ccaPermSize) != 0) {
+      RF_nativeError("\nRF-SRC:  *** ERROR *** ");
+      RF_nativeError("\nRF-SRC:  The number of trees must be a multiple of the number of permutations:  %10d %10d", RF_ntree, RF_ccaPermSize);
+      RF_nativeExit();
+    }
+    if (RF_mRecordSize > 0) {
+      RF_nativeError("\nRF-SRC:  *** ERROR *** ");
+      RF_nativeError("\nRF-SRC:  Permuted forests cannot be grown with missing data.");
+      RF_nativeExit();
+    }
+    RF_ccaPermObservation = (double ***) new_vvector(1, RF_ccaPermSize, NRUTIL_DPTR2);
+    for (p = 1; p <= RF_ccaPermSize; p++) {
+      RF_ccaPermObservation[p] = (double **) new_vvector(1, RF_xSize, NRUTIL_DPTR);
+      for (v = 1; v <= RF_xSize; v++) {
+        RF_ccaPermObservation[p][v] = dvector(1, RF_observationSize);
+        for (i = 1; i <= RF_observationSize; i++) {
+          RF_ccaPermObservation[p][v][i] = RF_observationIn[v][RF_ccaPermIn[(i - 1) + (p - 1) * RF_observationSize]];
+        }
+      }
+    }
+    treePerPerm = RF_ntree / RF_ccaPermSize;
+    for (b = 1; b <= RF_ntree; b++) {
+      RF_observation[b] = RF_ccaPermObservation[((b - 1) / treePerPerm) + 1];
+    }
+  }
+}
+void unstackCCAPermutation(char mode) { /* for rfcca */
+  uint p, v, b;
+  if (RF_ccaPermObservation != NULL) {
+    for (b = 1; b <= RF_ntree; b++) {
+      RF_observation[b] = RF_observationIn;
+    }
+    for (p = 1; p <= RF_ccaPermSize; p++) {
+      for (v = 1; v <= RF_xSize; v++) {
+        free_dvector(RF_ccaPermObservation[p][v], 1, RF_observationSize);
+      }
+      free_new_vvector(RF_ccaPermObservation[p], 1, RF_xSize, NRUTIL_DPTR);
+    }
+    free_new_vvector(RF_ccaPermObservation, 1, RF_ccaPermSize, NRUTIL_DPTR2);
+    RF_ccaPermObservation = NULL;
+  }
+}
+uint            *RF_ccaBinCount; /* for rfcca */
+double         **RF_ccaBinCut; /* for rfcca */
+unsigned short **RF_ccaBinCode; /* for rfcca */
+uint             RF_ccaTreePerPerm; /* for rfcca */
+void stackCCABins(char mode) { /* for rfcca */
+  uint v, i, b, m, count;
+  uint low, high, mid;
+  double *value;
+  RF_ccaBinCount = NULL;
+  RF_ccaBinCut   = NULL;
+  RF_ccaBinCode  = NULL;
+  RF_ccaTreePerPerm = (RF_ccaPermObservation != NULL) ? (RF_ntree / RF_ccaPermSize) : 0;
+  if ((mode == RF_GROW) && (RF_famCCA == 1) && (RF_ccaBins > 1)) {
+    if (RF_ccaBins > USHRT_MAX) {
+      RF_nativeError("\nRF-SRC:  *** ERROR *** ");
+      RF_nativeError("\nRF-SRC:  The number of bins cannot be greater than %10d:  %10d", USHRT_MAX, RF_ccaBins);
+      RF_nativeExit();
+    }
+    RF_ccaBinCount = uivector(1, RF_xSize);
+    RF_ccaBinCut   = (double **) new_vvector(1, RF_xSize, NRUTIL_DPTR);
+    RF_ccaBinCode  = (unsigned short **) new_vvector(1, RF_xSize, NRUTIL_VPTR);
+    value = dvector(1, RF_observationSize);
+    for (v = 1; v <= RF_xSize; v++) {
+      RF_ccaBinCount[v] = 0;
+      RF_ccaBinCut[v]   = NULL;
+      RF_ccaBinCode[v]  = NULL;
+      if ((RF_xType[v] == 'B') || (RF_xType[v] == 'C')) {
+        continue;
+      }
+      m = 0;
+      for (i = 1; i <= RF_observationSize; i++) {
+        if (!RF_nativeIsNaN(RF_observationIn[v][i])) {
+          value[++m] = RF_observationIn[v][i];
+        }
+      }
+      if (m < 2) {
+        continue;
+      }
+      sort(value, m);
+      // The bins hold about equal numbers of observations, with each bin
+      // ending at one of the values, the last at the largest.
+      RF_ccaBinCut[v] = dvector(1, RF_ccaBins);
+      count = 0;
+      for (b = 1; b <= RF_ccaBins; b++) {
+        i = (uint) ceil(((double) b * m) / RF_ccaBins);
+        if ((count == 0) || (value[i] > RF_ccaBinCut[v][count])) {
+          RF_ccaBinCut[v][++count] = value[i];
+        }
+      }
+      RF_ccaBinCount[v] = count;
+      RF_ccaBinCode[v] = (unsigned short *) gvector(1, RF_observationSize, sizeof(unsigned short)) - 1 + NR_END;
+      for (i = 1; i <= RF_observationSize; i++) {
+        RF_ccaBinCode[v][i] = 0;
+        if (!RF_nativeIsNaN(RF_observationIn[v][i])) {
+          low = 1;
+          high = count;
+          while (low < high) {
+            mid = (low + high) / 2;
+            if (RF_ccaBinCut[v][mid] >= RF_observationIn[v][i]) {
+              high = mid;
+            }
+            else {
+              low = mid + 1;
+            }
+          }
+          RF_ccaBinCode[v][i] = (unsigned short) low;
+        }
+      }
+    }
+    free_dvector(value, 1, RF_observationSize);
+  }
+}
+void unstackCCABins(char mode) { /* for rfcca */
+  uint v;
+  if (RF_ccaBinCount != NULL) {
+    for (v = 1; v <= RF_xSize; v++) {
+      if (RF_ccaBinCount[v] > 0) {
+        free_dvector(RF_ccaBinCut[v], 1, RF_ccaBins);
+        free_gvector(RF_ccaBinCode[v] + 1 - NR_END, 1, RF_observationSize, sizeof(unsigned short));
+      }
+    }
+    free_new_vvector(RF_ccaBinCode, 1, RF_xSize, NRUTIL_VPTR);
+    free_new_vvector(RF_ccaBinCut, 1, RF_xSize, NRUTIL_DPTR);
+    free_uivector(RF_ccaBinCount, 1, RF_xSize);
+    RF_ccaBinCount = NULL;
+    RF_ccaBinCut   = NULL;
+    RF_ccaBinCode  = NULL;
+  }
+}
+// Orders the nonMissMembrSize candidates of a binned covariate by
+// their bins with a counting sort, in place of sorting their values,
+// and sets the split vector to the ends of the bins of the node.  The
+// bins of the trees of a permuted forest follow the permutation.  The
+// counts and codes are drawn from the arena of the workspace of the
+// thread, and from the heap when there is none.
+void ccaBinSort(uint   treeID,
+                uint   covariate,
+                uint  *repMembrIndx,
+                uint  *nonMissMembrIndx,
+                uint   nonMissMembrSize,
+                uint  *indxx,
+                double *splitVector,
+                uint  *splitVectorSize) { /* for rfcca */
+  uint binCount = RF_ccaBinCount[covariate];
+  CCAWorkspace *ws = getCCAWorkspace();
+  CCAArenaMark mark;
+  uint *start, *code;
+  uint b, k, obs;
+  int *perm = NULL;
+  if (ws != NULL) {
+    mark  = ccaArenaSave(ws);
+    start = (uint *) ccaArenaAlloc(ws, (binCount + 1) * sizeof(uint)) - 1;
+    code  = (uint *) ccaArenaAlloc(ws, nonMissMembrSize * sizeof(uint)) - 1;
+  }
+  else {
+    start = uivector(1, binCount + 1);
+    code  = uivector(1, nonMissMembrSize);
+  }
+  if (RF_ccaTreePerPerm > 0) {
+    perm = RF_ccaPermIn + (size_t) ((treeID - 1) / RF_ccaTreePerPerm) * RF_observationSize;
+  }
+  for (b = 1; b <= binCount + 1; b++) {
+    start[b] = 0;
+  }
+  for (k = 1; k <= nonMissMembrSize; k++) {
+    obs = repMembrIndx[nonMissMembrIndx[k]];
+    if (perm != NULL) {
+      obs = (uint) perm[obs - 1];
+    }
+    code[k] = RF_ccaBinCode[covariate][obs];
+    start[code[k] + 1] ++;
+  }
+  *splitVectorSize = 0;
+  start[1] = 1;
+  for (b = 1; b <= binCount; b++) {
+    if (start[b + 1] > 0) {
+      splitVector[++(*splitVectorSize)] = RF_ccaBinCut[covariate][b];
+    }
+    start[b + 1] += start[b];
+  }
+  for (k = 1; k <= nonMissMembrSize; k++) {
+    indxx[start[code[k]] ++] = k;
+  }
+  if (ws != NULL) {
+    ccaArenaRelease(ws, mark);
+  }
+  else {
+    free_uivector(start, 1, binCount + 1);
+    free_uivector(code, 1, nonMissMembrSize);
+  }
+}
+uint **RF_ccaSortIndex; /* for rfcca */
+uint  *RF_ccaSortSize; /* for rfcca */
+// With the presorted mode, every tree sorts the bootstrap sample once by
+// each z-variable at the root, and the sorted lists are partitioned
+// stably into the daughters after each split, so that the nodes get the
+// order of their members without sorting.  The list of a covariate holds
+// the node positions of the members in the order of their values, ties
+// in the order of the positions, with the members of a node in a
+// contiguous segment starting at its ccaSortOffset.  The mode needs the
+// members of the daughters to keep their order in the parent, so it is
+// off with missing data and with bootstrapping in every node.
+void stackCCAPresort(char mode) { /* for rfcca */
+  uint b;
+  RF_ccaSortIndex = NULL;
+  RF_ccaSortSize  = NULL;
+  if ((mode == RF_GROW) && (RF_famCCA == 1) && (RF_ccaPresort) && (RF_mRecordSize == 0) &&
+      !((RF_opt & OPT_BOOT_TYP1) && !(RF_opt & OPT_BOOT_TYP2))) {
+    RF_ccaSortIndex = (uint **) new_vvector(1, RF_ntree, NRUTIL_UPTR);
+    RF_ccaSortSize  = uivector(1, RF_ntree);
+    for (b = 1; b <= RF_ntree; b++) {
+      RF_ccaSortIndex[b] = NULL;
+      RF_ccaSortSize[b]  = 0;
+    }
+  }
+}
+void unstackCCAPresort(char mode) { /* for rfcca */
+  if (RF_ccaSortIndex != NULL) {
+    free_new_vvector(RF_ccaSortIndex, 1, RF_ntree, NRUTIL_UPTR);
+    free_uivector(RF_ccaSortSize, 1, RF_ntree);
+    RF_ccaSortIndex = NULL;
+    RF_ccaSortSize  = NULL;
+  }
+}
+// The covariates a tree keeps sorted lists for: the binned ones are
+// ordered by their bins instead.
+static char ccaPresorted(uint covariate) { /* for rfcca */
+  return !((RF_ccaBinCount != NULL) && (RF_ccaBinCount[covariate] > 0));
+}
+// Sorts the root members of a tree by each covariate, with a bottom-up
+// merge sort that keeps ties in the order of their positions.  The
+// lists are followed by scratch space for two more.
+void ccaPresortTree(uint treeID, uint *repMembrIndx, uint repMembrSize) { /* for rfcca */
+  uint v, k, i, lo, mid, hi, width, a, b;
+  uint *order, *merged, *swap;
+  double *value;
+  RF_ccaSortSize[treeID]  = repMembrSize;
+  RF_ccaSortIndex[treeID] = uivector(1, (RF_xSize + 2) * repMembrSize);
+  for (v = 1; v <= RF_xSize; v++) {
+    if (!ccaPresorted(v)) {
+      continue;
+    }
+    value  = RF_observation[treeID][v];
+    order  = RF_ccaSortIndex[treeID] + (size_t) (v - 1) * repMembrSize;
+    merged = RF_ccaSortIndex[treeID] + (size_t) RF_xSize * repMembrSize;
+    for (k = 1; k <= repMembrSize; k++) {
+      order[k] = k;
+    }
+    for (width = 1; width < repMembrSize; width *= 2) {
+      for (lo = 1; lo <= repMembrSize; lo += 2 * width) {
+        mid = (lo + width <= repMembrSize + 1) ? (lo + width) : (repMembrSize + 1);
+        hi  = (lo + 2 * width <= repMembrSize + 1) ? (lo + 2 * width) : (repMembrSize + 1);
+        a = lo;
+        b = mid;
+        for (i = lo; i < hi; i++) {
+          if ((a < mid) && ((b >= hi) || (value[repMembrIndx[order[a]]] <= value[repMembrIndx[order[b]]]))) {
+            merged[i] = order[a++];
+          }
+          else {
+            merged[i] = order[b++];
+          }
+        }
+      }
+      swap = order;
+      order = merged;
+      merged = swap;
+    }
+    if (order != RF_ccaSortIndex[treeID] + (size_t) (v - 1) * repMembrSize) {
+      for (k = 1; k <= repMembrSize; k++) {
+        merged[k] = order[k];
+      }
+    }
+  }
+}
+void ccaUnsortTree(uint treeID) { /* for rfcca */
+  if (RF_ccaSortIndex[treeID] != NULL) {
+    free_uivector(RF_ccaSortIndex[treeID], 1, (RF_xSize + 2) * RF_ccaSortSize[treeID]);
+    RF_ccaSortIndex[treeID] = NULL;
+    RF_ccaSortSize[treeID]  = 0;
+  }
+}
+// The order of the members of a node by a covariate, read from its
+// segment of the sorted list, and the split vector of their values.
+void ccaPresortOrder(uint    treeID,
+                     Node   *parent,
+                     uint    covariate,
+                     uint   *repMembrIndx,
+                     uint    repMembrSize,
+                     uint   *indxx,
+                     double *splitVector,
+                     uint   *splitVectorSize) { /* for rfcca */
+  uint *sorted = RF_ccaSortIndex[treeID] + (size_t) (covariate - 1) * RF_ccaSortSize[treeID] + parent -> ccaSortOffset;
+  double *value = RF_observation[treeID][covariate];
+  uint k;
+  indxx[1] = sorted[1];
+  splitVector[1] = value[repMembrIndx[indxx[1]]];
+  *splitVectorSize = 1;
+  for (k = 2; k <= repMembrSize; k++) {
+    indxx[k] = sorted[k];
+    if (value[repMembrIndx[indxx[k]]] > splitVector[*splitVectorSize]) {
+      splitVector[++(*splitVectorSize)] = value[repMembrIndx[indxx[k]]];
+    }
+  }
+}
+// Partitions the segments of a split node stably into those of its
+// daughters, the left one first, renumbering the positions as in the
+// member lists of the daughters.
+void ccaPresortSplit(uint  treeID,
+                     Node *parent,
+                     uint *repMembrIndx,
+                     uint  repMembrSize,
+                     char *membershipIndicator) { /* for rfcca */
+  uint  size  = RF_ccaSortSize[treeID];
+  uint *rank  = RF_ccaSortIndex[treeID] + (size_t) RF_xSize * size;
+  uint *right = rank + size;
+  uint *sorted;
+  uint leftSize, rghtSize, v, k, pos;
+  leftSize = rghtSize = 0;
+  for (k = 1; k <= repMembrSize; k++) {
+    rank[k] = (membershipIndicator[repMembrIndx[k]] == LEFT) ? (++leftSize) : (++rghtSize);
+  }
+  for (v = 1; v <= RF_xSize; v++) {
+    if (!ccaPresorted(v)) {
+      continue;
+    }
+    sorted = RF_ccaSortIndex[treeID] + (size_t) (v - 1) * size + parent -> ccaSortOffset;
+    leftSize = rghtSize = 0;
+    for (k = 1; k <= repMembrSize; k++) {
+      pos = sorted[k];
+      if (membershipIndicator[repMembrIndx[pos]] == LEFT) {
+        sorted[++leftSize] = rank[pos];
+      }
+      else {
+        right[++rghtSize] = rank[pos];
+      }
+    }
+    for (k = 1; k <= rghtSize; k++) {
+      sorted[leftSize + k] = right[k];
+    }
+  }
+  (parent -> left)  -> ccaSortOffset = parent -> ccaSortOffset;
+  (parent -> right) -> ccaSortOffset = parent -> ccaSortOffset + leftSize;
+}
+// The workspaces of the node threads of a tree thread follow its own,
+// which is that of its first node thread.  There are none outside the
+// growing of a forest.
+CCAWorkspace *getCCAWorkspace(void) { /* for rfcca */
+  if (RF_ccaWorkspace == NULL) {
+    return NULL;
+  }
+#ifdef _OPENMP
+  if (omp_get_level() > 1) {
+    return RF_ccaWorkspace[(omp_get_ancestor_thread_num(1) * RF_ccaNodeThreads) + omp_get_thread_num() + 1];
+  }
+  return RF_ccaWorkspace[(omp_get_thread_num() * RF_ccaNodeThreads) + 1];
+#else
+  return RF_ccaWorkspace[1];
+#endif
+}
+// Scratch vector [1..nh] of the split search of a node, drawn from the
+// arena of the workspace when there is one and from the heap otherwise.
+// Vectors of the arena are given back when it is released, so that
+// unstackCCAScratch() only frees those of the heap.
+void *stackCCAScratch(CCAWorkspace *ws, uint nh, size_t size) { /* for rfcca */
+  if (ws != NULL) {
+    return (char *) ccaArenaAlloc(ws, nh * size) - size;
+  }
+  return (char *) gvector(1, nh, size) + ((NR_END - 1) * size);
+}
+void unstackCCAScratch(CCAWorkspace *ws, void *v, uint nh, size_t size) { /* for rfcca */
+  if (ws == NULL) {
+    free_gvector((char *) v - ((NR_END - 1) * size), 1, nh, size);
+  }
+}
+// Resets the arenas of the workspaces of the tree thread and its node
+// threads once its tree is grown.
+void resetCCAWorkspace(void) { /* for rfcca */
+  uint first, i;
+  first = 1;
+#ifdef _OPENMP
+  first = (omp_get_thread_num() * RF_ccaNodeThreads) + 1;
+#endif
+  for (i = first; i < first + RF_ccaNodeThreads; i++) {
+    ccaArenaReset(RF_ccaWorkspace[i]);
+  }
+}
+// Frees the warm starts of the power iteration kept by a node for the
+// split searches of its daughters.
+void unstackCCAStart(Node *parent) { /* for rfcca */
+  if (parent -> ccaStart != NULL) {
+    free_dvector(parent -> ccaStart, 1, 2 * (RF_mvdata1Size + RF_mvdata2Size));
+    parent -> ccaStart = NULL;
+  }
+}
+// Split statistics of the continuous split points of a covariate in a
+// large node, computed by the node threads of the tree thread for
+// chunks of consecutive split points.  The cross-product matrix of the
+// left daughter at the start of each chunk is accumulated beforehand
+// row by row, as in the serial sweep, so every statistic is the one of
+// the serial search.  Each chunk prunes against the best split it has
+// seen itself, without the tolerance of updateMaximumSplit(), so that
+// the splits it abandons are never those the serial search would take.
+// Returns the statistics [1..splitLength-1] of the split points, to be
+// passed to updateMaximumSplit() in their order.
+double *ccaNodeSweep(uint          covariate,
+                     uint          nonMissMembrSize,
+                     double       *observation,
+                     uint         *repMembrIndx,
+                     uint         *nonMissMembrIndx,
+                     uint         *indxx,
+                     double       *splitVector,
+                     uint          splitLength,
+                     double       *packed,
+                     double       *nodeGram,
+                     double        deltaMax,
+                     CCAWorkspace *ccaWorkspace) { /* for rfcca */
+  uint dim = RF_mvdata1Size + RF_mvdata2Size;
+  uint splitCount = splitLength - 1;
+  uint chunkCount = RF_ccaNodeThreads * CCA_NODE_CHUNKS;
+  uint *leftSize, *chunkStart;
+  double *chunkGram, *delta;
+  CCAArenaMark mark;
+  uint c, j, k;
+  if (chunkCount > splitCount) {
+    chunkCount = splitCount;
+  }
+  CCA_PROFILE_ADD(ccaWorkspace, CCA_PROF_NODE, 1);
+  // The statistics outlive the call, and go back to the arena with the
+  // other vectors of the covariate.
+  delta      = (double *) ccaArenaAlloc(ccaWorkspace, splitCount * sizeof(double)) - 1;
+  mark       = ccaArenaSave(ccaWorkspace);
+  leftSize   = (uint *)   ccaArenaAlloc(ccaWorkspace, (splitCount + 1) * sizeof(uint));
+  chunkStart = (uint *)   ccaArenaAlloc(ccaWorkspace, (chunkCount + 1) * sizeof(uint)) - 1;
+  chunkGram  = (double *) ccaArenaAlloc(ccaWorkspace, chunkCount * dim * dim * sizeof(double));
+  leftSize[0] = 0;
+  k = 0;
+  for (j = 1; j <= splitCount; j++) {
+    while ((k < nonMissMembrSize) && ((splitVector[j] - observation[repMembrIndx[nonMissMembrIndx[indxx[k + 1]]]]) >= 0.0)) {
+      k ++;
+    }
+    leftSize[j] = k;
+  }
+  for (c = 1; c <= chunkCount + 1; c++) {
+    chunkStart[c] = 1 + (((c - 1) * splitCount) / chunkCount);
+  }
+  for (k = 0; k < (dim * dim); k++) {
+    chunkGram[k] = 0.0;
+  }
+  for (c = 1; c < chunkCount; c++) {
+    double *gram = chunkGram + (c * dim * dim);
+    for (k = 0; k < (dim * dim); k++) {
+      gram[k] = chunkGram[((c - 1) * dim * dim) + k];
+    }
+    for (k = leftSize[chunkStart[c] - 1] + 1; k <= leftSize[chunkStart[c + 1] - 1]; k++) {
+      ccaWorkspace -> update(gram, dim, packed + (k - 1), nonMissMembrSize, 1.0);
+    }
+  }
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(RF_ccaNodeThreads) schedule(dynamic, 1)
+#endif
+  for (c = 1; c <= chunkCount; c++) {
+    CCAWorkspace *ws = getCCAWorkspace();
+    CCAArenaMark  chunkMark = ccaArenaSave(ws);
+    double *gram = ws -> leftGram;
+    char   *membership = NULL;
+    double  chunkMax = deltaMax;
+    double  cutoff, weighted;
+    int     info;
+    uint    jj, kk;
+    for (kk = 0; kk < (dim * dim); kk++) {
+      gram[kk] = chunkGram[((c - 1) * dim * dim) + kk];
+    }
+    for (jj = chunkStart[c]; jj < chunkStart[c + 1]; jj++) {
+      for (kk = leftSize[jj - 1] + 1; kk <= leftSize[jj]; kk++) {
+        ws -> update(gram, dim, packed + (kk - 1), nonMissMembrSize, 1.0);
+      }
+      cutoff = -1.0;
+      if ((RF_ccaPrune) && (!(RF_opt & OPT_NODE_STAT)) && (!RF_nativeIsNaN(chunkMax))) {
+        cutoff = (RF_xSplitStatWeight[covariate] > 0.0) ? (chunkMax / RF_xSplitStatWeight[covariate]) : DBL_MAX;
+      }
+      delta[jj] = ccaSweepSplitStatistic(leftSize[jj],
+                                         nonMissMembrSize,
+                                         gram,
+                                         nodeGram,
+                                         RF_mvdata1Size,
+                                         RF_mvdata2Size,
+                                         cutoff,
+                                         ws,
+                                         & info);
+      if (info != 0) {
+        if (membership == NULL) {
+          membership = (char *) ccaArenaAlloc(ws, nonMissMembrSize * sizeof(char)) - 1;
+        }
+        for (kk = 1; kk <= nonMissMembrSize; kk++) {
+          membership[kk] = (kk <= leftSize[jj]) ? LEFT : RIGHT;
+        }
+        CCA_PROFILE_ADD(ws, CCA_PROF_FALLBACK, 1);
+        delta[jj] = ccaSplitPacked(nonMissMembrSize,
+                                   membership,
+                                   packed,
+                                   nonMissMembrSize,
+                                   RF_mvdata1Size,
+                                   RF_mvdata2Size,
+                                   cutoff,
+                                   ws);
+      }
+      weighted = delta[jj] * RF_xSplitStatWeight[covariate];
+      if (RF_nativeIsNaN(chunkMax) || ((weighted - chunkMax) > EPSILON)) {
+        chunkMax = weighted;
+      }
+    }
+    ccaArenaRelease(ws, chunkMark);
+  }
+  ccaArenaRelease(ccaWorkspace, mark);
+  return delta;
+}
+SEXP ccaAppendProfile(SEXP output) { /* for rfcca */
+  static const char *ccaProfileName[CCA_PROF_CNT] = {
+    "nodes", "covariates", "rows.gathered", "kernel.calls", "wrapper.calls", "bound.pruned",
+    "chol.fallbacks", "svd.failures", "time.tree", "time.sort", "time.gather", "time.split",
+    "node.sweeps"
+  };
+  SEXP result, names, oldNames, profile, profileNames;
+  R_xlen_t size, i;
+  size = LENGTH(output);
+  oldNames = getAttrib(output, R_NamesSymbol);
+  PROTECT(result = allocVector(VECSXP, size + 1));
+  PROTECT(names = allocVector(STRSXP, size + 1));
+  for (i = 0; i < size; i++) {
+    SET_VECTOR_ELT(result, i, VECTOR_ELT(output, i));
+    SET_STRING_ELT(names, i, STRING_ELT(oldNames, i));
+  }
+  PROTECT(profile = allocVector(REALSXP, CCA_PROF_CNT));
+  PROTECT(profileNames = allocVector(STRSXP, CCA_PROF_CNT));
+  for (i = 0; i < CCA_PROF_CNT; i++) {
+    REAL(profile)[i] = RF_ccaProfileSum[i];
+    SET_STRING_ELT(profileNames, i, mkChar(ccaProfileName[i]));
+  }
+  setAttrib(profile, R_NamesSymbol, profileNames);
+  SET_VECTOR_ELT(result, size, profile);
+  SET_STRING_ELT(names, size, mkChar("ccaProfile"));
+  setAttrib(result, R_NamesSymbol, names);
+  UNPROTECT(4);
+  return result;
+}
 char getBestSplit(uint       treeID,
                   Node      *parent,
                   uint       splitRule,
@@ -15567,6 +16212,30 @@ char customMultivariateSplit (uint       treeID,
   uint   deltaNorm;
   uint j, k, m, r, rr;
   uint NumberOfFeatures  = 0; /* for rfcca*/
+  char    ccaPackedFlag, ccaCholFlag, ccaCovariateFlag, ccaNodeGramFlag; /* for rfcca */
+  CCAWorkspace *ccaWorkspace;
+  double *ccaPacked, *ccaNodeGram, *ccaLeftGram;
+  double  ccaSweepDelta, ccaCutoff;
+  int     ccaSweepInfo;
+  uint    ccaDim;
+  double  ccaClock; /* for rfcca */
+  double *ccaNodeDelta; /* for rfcca */
+  CCAArenaMark ccaNodeMark, ccaCovariateMark; /* for rfcca */
+  double *ccaSeed; /* for rfcca */
+  double  ccaDeltaMax; /* for rfcca */
+  ccaPackedFlag          = FALSE;
+  ccaClock               = 0.0;
+  ccaCholFlag           = FALSE;
+  ccaCovariateFlag       = FALSE;
+  ccaNodeGramFlag        = FALSE;
+  ccaWorkspace           = NULL;
+  ccaPacked = ccaNodeGram = ccaLeftGram = NULL;
+  ccaNodeDelta           = NULL;
+  ccaSeed                = NULL;
+  ccaSweepDelta          = 0.0;
+  ccaCutoff              = -1.0;
+  ccaSweepInfo           = 0;
+  ccaDim                 = 0;
   localSplitIndicator    = NULL;  
   splitVector            = NULL;  
   splitVectorSize        = 0;     
@@ -15586,9 +16255,15 @@ char customMultivariateSplit (uint       treeID,
                                         multImpFlag,
                                         TRUE);
   if (preliminaryResult) {
-    char   *impurity   = cvector(1, RF_ySize);
-    double *mean       = dvector(1, RF_ySize);
-    double *variance   = dvector(1, RF_ySize);
+    if ((RF_famCCA == 1) && (RF_ccaWorkspace != NULL)) { /* for rfcca */
+      if ((RF_mRecordSize == 0) || (multImpFlag) || (!(RF_optHigh & OPT_MISS_SKIP))) {
+        ccaWorkspace = getCCAWorkspace();
+        ccaNodeMark = ccaArenaSave(ccaWorkspace);
+      }
+    }
+    char   *impurity   = (char *)   stackCCAScratch(ccaWorkspace, RF_ySize, sizeof(char));
+    double *mean       = (double *) stackCCAScratch(ccaWorkspace, RF_ySize, sizeof(double));
+    double *variance   = (double *) stackCCAScratch(ccaWorkspace, RF_ySize, sizeof(double));
     char impuritySummary;
     if ((RF_mRecordSize == 0) || (multImpFlag) || (!(RF_optHigh & OPT_MISS_SKIP))) {
       impuritySummary = FALSE;
@@ -15612,9 +16287,15 @@ char customMultivariateSplit (uint       treeID,
       impuritySummary = TRUE;
     }
     if (impuritySummary) {
-      stackSplitIndicator(repMembrSize,
-                          & localSplitIndicator,
-                          & splitVector);
+      if (ccaWorkspace != NULL) { /* for rfcca */
+        splitVector         = (double *) stackCCAScratch(ccaWorkspace, repMembrSize, sizeof(double));
+        localSplitIndicator = (char *)   stackCCAScratch(ccaWorkspace, repMembrSize, sizeof(char));
+      }
+      else {
+        stackSplitIndicator(repMembrSize,
+                            & localSplitIndicator,
+                            & splitVector);
+      }
       stackRandomCovariates(treeID,
                             parent,
                             repMembrSize,
@@ -15627,16 +16308,30 @@ char customMultivariateSplit (uint       treeID,
                             & density,
                             & densitySize,
                             & densitySwap);
-      char **secondNonMissMembrFlag = (char **) new_vvector(1, RF_ySize, NRUTIL_CPTR);
-      uint  *secondNonMissMembrSize =           uivector(1, RF_ySize);
-      uint  *secondNonMissMembrLeftSize =       uivector(1, RF_ySize);
-      uint  *secondNonMissMembrRghtSize =       uivector(1, RF_ySize);
+      char **secondNonMissMembrFlag = (char **) stackCCAScratch(ccaWorkspace, RF_ySize, sizeof(char *));
+      uint  *secondNonMissMembrSize =     (uint *) stackCCAScratch(ccaWorkspace, RF_ySize, sizeof(uint));
+      uint  *secondNonMissMembrLeftSize = (uint *) stackCCAScratch(ccaWorkspace, RF_ySize, sizeof(uint));
+      uint  *secondNonMissMembrRghtSize = (uint *) stackCCAScratch(ccaWorkspace, RF_ySize, sizeof(uint));
       char  *tempNonMissMembrFlag = 0;
       uint  *tempNonMissMembrIndx;
       char   mResponseFlag;
       char   nonMissImpuritySummary;
       uint actualCovariateCount = 0;
       uint candidateCovariateCount = 0;
+      if (ccaWorkspace != NULL) { /* for rfcca */
+        ccaPackedFlag = TRUE;
+        ccaDim = RF_mvdata1Size + RF_mvdata2Size;
+        ccaPacked = ccaWorkspace -> packed;
+        CCA_PROFILE_ADD(ccaWorkspace, CCA_PROF_NODES, 1);
+        if ((parent -> parent != NULL) && ((parent -> parent) -> ccaStart != NULL)) {
+          ccaSeed = (parent -> parent) -> ccaStart + 1 + (((parent -> parent) -> left == parent) ? 0 : ccaDim);
+        }
+        if (ccaSelectEngine(RF_ccaEngine, repMembrSize, RF_mvdata1Size, RF_mvdata2Size) == CCA_ENGINE_CHOL) {
+          ccaCholFlag = TRUE;
+          ccaNodeGram = ccaWorkspace -> nodeGram;
+          ccaLeftGram = ccaWorkspace -> leftGram;
+        }
+      }
       while (selectRandomCovariates(treeID,
                                     parent,
                                     repMembrIndx,
@@ -15661,8 +16356,12 @@ char customMultivariateSplit (uint       treeID,
                                     & nonMissMembrSize,
                                     & nonMissMembrIndx,
                                     multImpFlag)) {
+        if (ccaWorkspace != NULL) { /* for rfcca */
+          ccaCovariateMark = ccaArenaSave(ccaWorkspace);
+          ccaSeedStart(ccaWorkspace, ccaSeed);
+        }
         if ((RF_mRecordSize == 0) || (multImpFlag) || (!(RF_optHigh & OPT_MISS_SKIP))) {
-          tempNonMissMembrFlag = cvector(1, nonMissMembrSize);
+          tempNonMissMembrFlag = (char *) stackCCAScratch(ccaWorkspace, nonMissMembrSize, sizeof(char));
           for (k = 1; k <= nonMissMembrSize; k++) {
             tempNonMissMembrFlag[k] = TRUE;
           }
@@ -15738,11 +16437,63 @@ char customMultivariateSplit (uint       treeID,
               }
             }
           }
-          double *userResponse = dvector(1, nonMissMembrSize);
-          char   *userSplitIndicator = cvector(1, nonMissMembrSize);
+          if ((ccaPackedFlag) && (ccaWorkspace -> profiling)) { /* for rfcca */
+            ccaClock = ccaProfileClock();
+          }
+          if (ccaPackedFlag) { /* for rfcca */
+            for (rr = 1; rr <= ccaDim; rr++) {
+              for (k = 1; k <= nonMissMembrSize; k++) {
+                ccaPacked[(k - 1) + ((rr - 1) * nonMissMembrSize)] = RF_ccaVar[treeID][rr][ repMembrIndx[nonMissMembrIndx[indxx[k]]] ];
+              }
+            }
+          }
+          ccaCovariateFlag = (ccaCholFlag) && (nonMissMembrSize == repMembrSize);
+          if (ccaCovariateFlag) {
+            if (!ccaNodeGramFlag) {
+              for (k = 0; k < (ccaDim * ccaDim); k++) {
+                ccaNodeGram[k] = 0.0;
+              }
+              for (k = 1; k <= nonMissMembrSize; k++) {
+                ccaWorkspace -> update(ccaNodeGram, ccaDim, ccaPacked + (k - 1), nonMissMembrSize, 1.0);
+              }
+              ccaNodeGramFlag = TRUE;
+            }
+            for (k = 0; k < (ccaDim * ccaDim); k++) {
+              ccaLeftGram[k] = 0.0;
+            }
+          }
+          if ((ccaPackedFlag) && (ccaWorkspace -> profiling)) { /* for rfcca */
+            ccaWorkspace -> profile[CCA_PROF_COVARIATE] += 1;
+            ccaWorkspace -> profile[CCA_PROF_ROWS] += nonMissMembrSize;
+            ccaWorkspace -> profile[CCA_PROF_GATHER] += ccaProfileClock() - ccaClock;
+          }
+          if ((ccaCovariateFlag) && (factorFlag == FALSE) && (RF_ccaSweep) && (RF_ccaTol == 0.0) &&
+              (RF_ccaNodeThreads > 1) && (nonMissMembrSize >= CCA_NODE_MIN) && (splitLength > 2) &&
+              (RF_ySize == 1) && (impurity[1])) { /* for rfcca */
+            if (ccaWorkspace -> profiling) {
+              ccaClock = ccaProfileClock();
+            }
+            ccaNodeDelta = ccaNodeSweep(covariate,
+                                        nonMissMembrSize,
+                                        RF_observation[treeID][covariate],
+                                        repMembrIndx,
+                                        nonMissMembrIndx,
+                                        indxx,
+                                        (double *) splitVectorPtr,
+                                        splitLength,
+                                        ccaPacked,
+                                        ccaNodeGram,
+                                        deltaMax,
+                                        ccaWorkspace);
+            if (ccaWorkspace -> profiling) {
+              ccaWorkspace -> profile[CCA_PROF_SPLIT] += ccaProfileClock() - ccaClock;
+            }
+          }
+          double *userResponse = (double *) stackCCAScratch(ccaWorkspace, nonMissMembrSize, sizeof(double));
+          char   *userSplitIndicator = (char *) stackCCAScratch(ccaWorkspace, nonMissMembrSize, sizeof(char));
           double **userFeature = NULL;
           if(RF_famCCA == 1) {
-            if( (RF_mvdata1Size + RF_mvdata2Size) > 0 ) {
+            if( ((RF_mvdata1Size + RF_mvdata2Size) > 0) && (!ccaPackedFlag) ) {
               userFeature = dmatrix(1, (RF_mvdata1Size + RF_mvdata2Size + 1), 1, nonMissMembrSize);     // for rfcca the userFeature information is changed
             }
           }
@@ -15779,6 +16530,47 @@ char customMultivariateSplit (uint       treeID,
             delta        = 0.0;
             deltaPartial = 0.0;
             deltaNorm    = 0;
+            ccaCutoff    = -1.0; /* for rfcca */
+            if ((ccaPackedFlag) && (RF_ccaPrune) && (!(RF_opt & OPT_NODE_STAT)) && (!RF_nativeIsNaN(deltaMax))) {
+              if (RF_xSplitStatWeight[covariate] > 0.0) {
+                ccaCutoff = (deltaMax + EPSILON) / RF_xSplitStatWeight[covariate];
+              }
+              else {
+                ccaCutoff = DBL_MAX;
+              }
+            }
+            if ((ccaCovariateFlag) && (ccaNodeDelta == NULL)) { /* for rfcca */
+              if ((factorFlag == FALSE) && (RF_ccaSweep)) {
+                for (k = priorMembrIter + 1; k < currentMembrIter; k++) {
+                  ccaWorkspace -> update(ccaLeftGram, ccaDim, ccaPacked + (k - 1), nonMissMembrSize, 1.0);
+                }
+              }
+              else {
+                for (k = 0; k < (ccaDim * ccaDim); k++) {
+                  ccaLeftGram[k] = 0.0;
+                }
+                for (k = 1; k <= nonMissMembrSize; k++) {
+                  if (localSplitIndicator[ nonMissMembrIndx[indxx[k]] ] == LEFT) {
+                    ccaWorkspace -> update(ccaLeftGram, ccaDim, ccaPacked + (k - 1), nonMissMembrSize, 1.0);
+                  }
+                }
+              }
+              if (ccaWorkspace -> profiling) {
+                ccaClock = ccaProfileClock();
+              }
+              ccaSweepDelta = ccaSweepSplitStatistic(leftSize,
+                                                     nonMissMembrSize,
+                                                     ccaLeftGram,
+                                                     ccaNodeGram,
+                                                     RF_mvdata1Size,
+                                                     RF_mvdata2Size,
+                                                     ccaCutoff,
+                                                     ccaWorkspace,
+                                                     & ccaSweepInfo);
+              if (ccaWorkspace -> profiling) {
+                ccaWorkspace -> profile[CCA_PROF_SPLIT] += ccaProfileClock() - ccaClock;
+              }
+            }
             for (r = 1; r <= RF_ySize; r++) {
               if (impurity[r]) {
                 if (factorFlag == TRUE) {
@@ -15801,7 +16593,44 @@ char customMultivariateSplit (uint       treeID,
                     }
                   }
                 }  
-                if ((secondNonMissMembrLeftSize[r] > 0) && (secondNonMissMembrRghtSize[r] > 0)) {
+                if ((secondNonMissMembrLeftSize[r] > 0) && (secondNonMissMembrRghtSize[r] > 0) && (ccaNodeDelta != NULL)) { /* for rfcca */
+                  deltaPartial = ccaNodeDelta[j];
+                  deltaNorm ++;
+                  delta += deltaPartial;
+                }
+                else if ((secondNonMissMembrLeftSize[r] > 0) && (secondNonMissMembrRghtSize[r] > 0) && (ccaCovariateFlag) && (ccaSweepInfo == 0)) { /* for rfcca */
+                  deltaPartial = ccaSweepDelta;
+                  deltaNorm ++;
+                  delta += deltaPartial;
+                }
+                else if ((secondNonMissMembrLeftSize[r] > 0) && (secondNonMissMembrRghtSize[r] > 0) && (ccaPackedFlag)) {
+                  for (k = 1; k <= nonMissMembrSize; k++) {
+                    userSplitIndicator[k] = localSplitIndicator[ nonMissMembrIndx[indxx[k]] ];
+                  }
+                  if (ccaWorkspace -> profiling) {
+                    ccaClock = ccaProfileClock();
+                    if (ccaCovariateFlag) {
+                      ccaWorkspace -> profile[CCA_PROF_FALLBACK] += 1;
+                    }
+                  }
+                  deltaPartial = ccaSplitPacked(nonMissMembrSize,
+                                                userSplitIndicator,
+                                                ccaPacked,
+                                                nonMissMembrSize,
+                                                RF_mvdata1Size,
+                                                RF_mvdata2Size,
+                                                ccaCutoff,
+                                                ccaWorkspace);
+                  if (ccaWorkspace -> profiling) {
+                    ccaWorkspace -> profile[CCA_PROF_SPLIT] += ccaProfileClock() - ccaClock;
+                  }
+                  deltaNorm ++;
+                  delta += deltaPartial;
+                }
+                else if ((secondNonMissMembrLeftSize[r] > 0) && (secondNonMissMembrRghtSize[r] > 0)) {
+                  if ((RF_famCCA == 1) && (RF_ccaWorkspace != NULL)) { /* for rfcca */
+                    CCA_PROFILE_ADD(getCCAWorkspace(), CCA_PROF_WRAPPER, 1);
+                  }
                   m = 0;
                   for (k = 1; k <= nonMissMembrSize; k++) {
                     if (secondNonMissMembrFlag[r][k] == TRUE) {
@@ -15868,6 +16697,7 @@ char customMultivariateSplit (uint       treeID,
             else {
               delta = RF_nativeNaN;
             }
+            ccaDeltaMax = deltaMax; /* for rfcca */
             updateMaximumSplit(treeID,
                                parent,
                                delta,
@@ -15887,12 +16717,19 @@ char customMultivariateSplit (uint       treeID,
                                splitAugmMaxPairTwo,
                                splitVectorPtr,
                                splitIndicator);
+            if ((ccaPackedFlag) && (RF_ccaTol > 0.0) && (!RF_nativeIsNaN(deltaMax)) &&
+                ((RF_nativeIsNaN(ccaDeltaMax)) || (deltaMax != ccaDeltaMax))) { /* for rfcca */
+              if (parent -> ccaStart == NULL) {
+                parent -> ccaStart = dvector(1, 2 * ccaDim);
+              }
+              ccaSaveStart(ccaWorkspace, parent -> ccaStart + 1);
+            }
             if (factorFlag == FALSE) {
               priorMembrIter = currentMembrIter - 1;
             }
           }  
           if(RF_famCCA == 1) {
-            if( (RF_mvdata1Size + RF_mvdata2Size) > 0 ) {
+            if( ((RF_mvdata1Size + RF_mvdata2Size) > 0) && (!ccaPackedFlag) ) {
               free_dmatrix (userFeature, 1, NumberOfFeatures, 1, nonMissMembrSize);
             }
           }
@@ -15901,8 +16738,9 @@ char customMultivariateSplit (uint       treeID,
               free_dmatrix (userFeature, 1, NumberOfFeatures, 1, nonMissMembrSize);
             }
           }
-          free_dvector (userResponse, 1, nonMissMembrSize);
-          free_cvector (userSplitIndicator, 1, nonMissMembrSize);
+          unstackCCAScratch(ccaWorkspace, userResponse, nonMissMembrSize, sizeof(double));
+          unstackCCAScratch(ccaWorkspace, userSplitIndicator, nonMissMembrSize, sizeof(char));
+          ccaNodeDelta = NULL; /* for rfcca */
           unstackSplitVector(treeID,
                              splitVectorSize,
                              splitLength,
@@ -15919,18 +16757,21 @@ char customMultivariateSplit (uint       treeID,
                                  nonMissMembrIndx,
                                  multImpFlag);
         if ((RF_mRecordSize == 0) || (multImpFlag) || (!(RF_optHigh & OPT_MISS_SKIP))) {
-          free_cvector(tempNonMissMembrFlag, 1, nonMissMembrSize);
+          unstackCCAScratch(ccaWorkspace, tempNonMissMembrFlag, nonMissMembrSize, sizeof(char));
         }
         else {
           for (r = 1; r <= RF_ySize; r++)  {
             free_cvector(secondNonMissMembrFlag[r], 1, nonMissMembrSize);
           }
         }
+        if (ccaWorkspace != NULL) { /* for rfcca */
+          ccaArenaRelease(ccaWorkspace, ccaCovariateMark);
+        }
       }  
-      free_new_vvector(secondNonMissMembrFlag,  1, RF_ySize, NRUTIL_CPTR);
-      free_uivector(secondNonMissMembrSize,     1, RF_ySize);
-      free_uivector(secondNonMissMembrLeftSize, 1, RF_ySize);
-      free_uivector(secondNonMissMembrRghtSize, 1, RF_ySize);
+      unstackCCAScratch(ccaWorkspace, secondNonMissMembrFlag,     RF_ySize, sizeof(char *));
+      unstackCCAScratch(ccaWorkspace, secondNonMissMembrSize,     RF_ySize, sizeof(uint));
+      unstackCCAScratch(ccaWorkspace, secondNonMissMembrLeftSize, RF_ySize, sizeof(uint));
+      unstackCCAScratch(ccaWorkspace, secondNonMissMembrRghtSize, RF_ySize, sizeof(uint));
       unstackRandomCovariates(treeID,
                               parent,
                               randomCovariateIndex,
@@ -15938,13 +16779,18 @@ char customMultivariateSplit (uint       treeID,
                               cdfSort,
                               density,
                               densitySwap);
-      unstackSplitIndicator(repMembrSize,
-                            localSplitIndicator,
-                            splitVector);
+      if (ccaWorkspace == NULL) {
+        unstackSplitIndicator(repMembrSize,
+                              localSplitIndicator,
+                              splitVector);
+      }
     }  
-    free_cvector(impurity,   1, RF_ySize);
-    free_dvector(mean,       1, RF_ySize);
-    free_dvector(variance,   1, RF_ySize);
+    unstackCCAScratch(ccaWorkspace, impurity, RF_ySize, sizeof(char));
+    unstackCCAScratch(ccaWorkspace, mean,     RF_ySize, sizeof(double));
+    unstackCCAScratch(ccaWorkspace, variance, RF_ySize, sizeof(double));
+    if (ccaWorkspace != NULL) { /* for rfcca */
+      ccaArenaRelease(ccaWorkspace, ccaNodeMark);
+    }
   }  
   unstackPreSplit(preliminaryResult,
                   repMembrSize,
@@ -16998,6 +17844,7 @@ char selectRandomCovariates(uint     treeID,
   char mPredictorFlag;
   char xVarFound;
   uint xWeightTypeOverride;
+  double ccaSortStart = 0.0; /* for rfcca */
   if (nonMissMembrSizeStatic < 1) {
     RF_nativeError("\nRF-SRC:  *** ERROR *** ");
     RF_nativeError("\nRF-SRC:  Invalid nonMissMembrSizeStatic encountered in selectRandomCovariates():  %10d", nonMissMembrSizeStatic);
@@ -17134,7 +17981,31 @@ char selectRandomCovariates(uint     treeID,
         xVarFound = FALSE;
         (*covariate) = 0;          
       }
-      if (xVarFound) {
+      if ((RF_ccaProfile) && (RF_ccaWorkspace != NULL)) { /* for rfcca */
+        ccaSortStart = ccaProfileClock();
+      }
+      if ((xVarFound) && (RF_ccaBinCount != NULL) && (candidateCovariate <= RF_xSize) && (RF_ccaBinCount[candidateCovariate] > 0)) { /* for rfcca */
+        ccaBinSort(treeID,
+                   candidateCovariate,
+                   repMembrIndx,
+                   (*nonMissMembrIndx),
+                   (*nonMissMembrSize),
+                   (*indxx),
+                   splitVector,
+                   splitVectorSize);
+      }
+      else if (xVarFound) {
+        if ((RF_ccaSortIndex != NULL) && (RF_ccaSortIndex[treeID] != NULL) && (candidateCovariate <= RF_xSize)) { /* for rfcca */
+          ccaPresortOrder(treeID,
+                          parent,
+                          candidateCovariate,
+                          repMembrIndx,
+                          (*nonMissMembrSize),
+                          (*indxx),
+                          splitVector,
+                          splitVectorSize);
+        }
+        else {
         indexx((*nonMissMembrSize),
                nonMissSplit,
                (*indxx));
@@ -17146,6 +18017,7 @@ char selectRandomCovariates(uint     treeID,
             splitVector[(*splitVectorSize)] = nonMissSplit[(*indxx)[i]];
           }
         }
+        }
         if((*splitVectorSize) >= 2) {
         }
         else {
@@ -17153,6 +18025,9 @@ char selectRandomCovariates(uint     treeID,
           (*covariate) = 0;          
         }
       }  
+      if ((RF_ccaProfile) && (RF_ccaWorkspace != NULL)) { /* for rfcca */
+        CCA_PROFILE_ADD(getCCAWorkspace(), CCA_PROF_SORT, ccaProfileClock() - ccaSortStart);
+      }
       if (!xVarFound) {
         if (candidateCovariate <= RF_xSize) {
           (parent -> permissibleSplit)[candidateCovariate] = FALSE;
@@ -24360,8 +25235,12 @@ void acquireTree(char mode, uint r, uint b) {
   Terminal ***gTermMembership;
   uint     obsSize;
   uint i;
+  double ccaTreeStart = 0.0; /* for rfcca */
 #ifdef _OPENMP
 #endif
+  if ((RF_ccaProfile) && (RF_ccaWorkspace != NULL)) { /* for rfcca */
+    ccaTreeStart = ccaProfileClock();
+  }
   RF_root[b] = makeNode((mode == RF_GROW) ? RF_xSize : 0,
                         (RF_opt & OPT_USPV_STAT) ? RF_ytry : 0,  
                         (mode == RF_GROW) ? ( (RF_opt & OPT_NODE_STAT) ? RF_mtry : 0)  : 0);  
@@ -24570,6 +25449,9 @@ void acquireTree(char mode, uint r, uint b) {
   unstackAuxiliary(mode, b);
   }
   freeTree(b, RF_root[b]);
+  if ((RF_ccaProfile) && (RF_ccaWorkspace != NULL)) { /* for rfcca */
+    CCA_PROFILE_ADD(getCCAWorkspace(), CCA_PROF_TREE, ccaProfileClock() - ccaTreeStart);
+  }
 }
 void finalizeWeight(char mode) {
   uint    obsSize;
@@ -25705,6 +26587,13 @@ char growTree (uint     r,
                             allMembrSize,
                             bootMembrIndx,
                             bootMembrSize);
+    if (rootFlag & bootResult & (RF_ccaSortIndex != NULL)) { /* for rfcca */
+      double ccaSortStart = ((RF_ccaProfile) && (RF_ccaWorkspace != NULL)) ? ccaProfileClock() : 0.0;
+      ccaPresortTree(treeID, bootMembrIndx, bootMembrSize);
+      if ((RF_ccaProfile) && (RF_ccaWorkspace != NULL)) {
+        CCA_PROFILE_ADD(getCCAWorkspace(), CCA_PROF_SORT, ccaProfileClock() - ccaSortStart);
+      }
+    }
     if (rootFlag & bootResult) {
       if (!( (RF_opt & OPT_BOOT_TYP1) && !(RF_opt & OPT_BOOT_TYP2) )) {
         bsUpdateFlag = TRUE;
@@ -25889,6 +26778,13 @@ char growTree (uint     r,
           }
           (parent ->  left) -> repMembrSize = leftRepMembrSize;
           (parent -> right) -> repMembrSize = rghtRepMembrSize;
+          if ((RF_ccaSortIndex != NULL) && (RF_ccaSortIndex[treeID] != NULL)) { /* for rfcca */
+            double ccaSortStart = ((RF_ccaProfile) && (RF_ccaWorkspace != NULL)) ? ccaProfileClock() : 0.0;
+            ccaPresortSplit(treeID, parent, bootMembrIndx, bootMembrSize, membershipIndicator);
+            if ((RF_ccaProfile) && (RF_ccaWorkspace != NULL)) {
+              CCA_PROFILE_ADD(getCCAWorkspace(), CCA_PROF_SORT, ccaProfileClock() - ccaSortStart);
+            }
+          }
         }
         free_cvector(membershipIndicator, 1, RF_observationSize);
         leftResult = growTree (r,
@@ -25911,6 +26807,7 @@ char growTree (uint     r,
                                ambrIterator);
         if(!rghtResult) {
         }
+        unstackCCAStart(parent); /* for rfcca */
         free_uivector((parent -> left)  -> allMembrIndx, 1, (parent -> left)  -> allMembrSize);
         free_uivector((parent -> right) -> allMembrIndx, 1, (parent -> right) -> allMembrSize);
         (parent -> left) -> allMembrIndx = (parent -> right) -> allMembrIndx = NULL;
@@ -26021,6 +26918,12 @@ char growTree (uint     r,
     }
     parent -> repMembrIndx = NULL;
     parent -> repMembrSizeAlloc = 0;
+    if (rootFlag && (RF_ccaSortIndex != NULL)) { /* for rfcca */
+      ccaUnsortTree(treeID);
+    }
+    if (rootFlag && (RF_ccaWorkspace != NULL)) { /* for rfcca */
+      resetCCAWorkspace();
+    }
   }
   return bootResult;
 }
@@ -26912,6 +27815,7 @@ SEXP rfsrcGrow(SEXP traceFlag,
                SEXP mvdata1Size,
                SEXP mvdata2Size,
                SEXP ccaData,
+               SEXP ccaSplit,
                SEXP xSize,
                SEXP xType,
                SEXP xLevels,
@@ -26984,6 +27888,54 @@ SEXP rfsrcGrow(SEXP traceFlag,
   if (RF_famCCA == 1){
     RF_ccaVarIn             = (double **) copy2DObject(ccaData, NATIVE_TYPE_NUMERIC, TRUE, (RF_mvdata1Size + RF_mvdata2Size), RF_observationSize);
   }
+  RF_ccaSweep = TRUE;
+  if (VECTOR_ELT(ccaSplit, 0) != R_NilValue) {
+    RF_ccaSweep = INTEGER(VECTOR_ELT(ccaSplit, 0))[0];
+  }
+  RF_ccaEngine = CCA_ENGINE_AUTO;
+  if (VECTOR_ELT(ccaSplit, 1) != R_NilValue) {
+    RF_ccaEngine = INTEGER(VECTOR_ELT(ccaSplit, 1))[0];
+  }
+  RF_ccaTol = 0.0;
+  if (VECTOR_ELT(ccaSplit, 2) != R_NilValue) {
+    RF_ccaTol = REAL(VECTOR_ELT(ccaSplit, 2))[0];
+  }
+  RF_ccaPrune = TRUE;
+  if (VECTOR_ELT(ccaSplit, 3) != R_NilValue) {
+    RF_ccaPrune = INTEGER(VECTOR_ELT(ccaSplit, 3))[0];
+  }
+  RF_ccaPermSize = 0;
+  RF_ccaPermIn = NULL;
+  if ((LENGTH(ccaSplit) > 4) && (VECTOR_ELT(ccaSplit, 4) != R_NilValue)) {
+    RF_ccaPermIn = INTEGER(VECTOR_ELT(ccaSplit, 4));
+    RF_ccaPermSize = LENGTH(VECTOR_ELT(ccaSplit, 4)) / RF_observationSize;
+  }
+  RF_ccaBins = 0;
+  if ((LENGTH(ccaSplit) > 5) && (VECTOR_ELT(ccaSplit, 5) != R_NilValue)) {
+    RF_ccaBins = INTEGER(VECTOR_ELT(ccaSplit, 5))[0];
+  }
+  RF_ccaBlasThreads = RFCCA_BLAS_AUTO;
+  if ((LENGTH(ccaSplit) > 6) && (VECTOR_ELT(ccaSplit, 6) != R_NilValue)) {
+    RF_ccaBlasThreads = INTEGER(VECTOR_ELT(ccaSplit, 6))[0];
+  }
+  RF_ccaProfile = FALSE;
+  if ((LENGTH(ccaSplit) > 7) && (VECTOR_ELT(ccaSplit, 7) != R_NilValue)) {
+    RF_ccaProfile = INTEGER(VECTOR_ELT(ccaSplit, 7))[0];
+  }
+  RF_ccaTreeOffset = 0;
+  if ((LENGTH(ccaSplit) > 8) && (VECTOR_ELT(ccaSplit, 8) != R_NilValue)) {
+    RF_ccaTreeOffset = INTEGER(VECTOR_ELT(ccaSplit, 8))[0];
+  }
+  RF_ccaPresort = FALSE;
+  if ((LENGTH(ccaSplit) > 9) && (VECTOR_ELT(ccaSplit, 9) != R_NilValue)) {
+    RF_ccaPresort = INTEGER(VECTOR_ELT(ccaSplit, 9))[0];
+  }
+  RF_ccaNodeThreads = 1;
+#ifdef _OPENMP
+  if ((LENGTH(ccaSplit) > 10) && (VECTOR_ELT(ccaSplit, 10) != R_NilValue)) {
+    RF_ccaNodeThreads = INTEGER(VECTOR_ELT(ccaSplit, 10))[0];
+  }
+#endif
   RF_xSize                = INTEGER(xSize)[0];
   RF_xType                = (char *) copy1DObject(xType, NATIVE_TYPE_CHARACTER, RF_xSize, TRUE);
   RF_xLevels              = (uint *) INTEGER(xLevels); RF_xLevels--;
@@ -27025,6 +27977,7 @@ SEXP rfsrcGrow(SEXP traceFlag,
   RF_numThreads           = INTEGER(numThreads)[0];
   processDefaultGrow();
   rfsrc(RF_GROW, seedValue);
+  RF_ccaTreeOffset = 0; /* for rfcca */
   free_1DObject(RF_rType, NATIVE_TYPE_CHARACTER, RF_ySize);
   free_1DObject(RF_xType, NATIVE_TYPE_CHARACTER, RF_xSize);
   free_2DObject(RF_responseIn, NATIVE_TYPE_NUMERIC, RF_ySize > 0, RF_ySize, RF_observationSize);
@@ -27035,6 +27988,13 @@ SEXP rfsrcGrow(SEXP traceFlag,
     free_2DObject(RF_ccaVarIn, NATIVE_TYPE_NUMERIC, TRUE, (RF_mvdata1Size + RF_mvdata2Size), RF_observationSize);
   }
   memoryCheck();
+  if (RF_ccaProfile) { /* for rfcca */
+    SEXP ccaOutput = PROTECT(ccaAppendProfile(RF_sexpVector[RF_OUTP_ID]));
+    R_ReleaseObject(RF_sexpVector[RF_OUTP_ID]);
+    R_ReleaseObject(RF_sexpVector[RF_STRG_ID]);  
+    UNPROTECT(1);
+    return ccaOutput;
+  }
   R_ReleaseObject(RF_sexpVector[RF_OUTP_ID]);
   R_ReleaseObject(RF_sexpVector[RF_STRG_ID]);  
   return RF_sexpVector[RF_OUTP_ID];
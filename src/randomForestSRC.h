@@ -269,6 +269,8 @@ struct node {
   uint  allMembrSizeAlloc;
   uint  repMembrSize;
   uint  allMembrSize;
+  uint  ccaSortOffset; /* for rfcca */
+  double *ccaStart; /* for rfcca */
 };
 typedef struct splitInfo SplitInfo;
 struct splitInfo {
@@ -775,6 +777,7 @@ float randomUChainSerial(uint b);
 float randomUChainSerialCov(uint b);
 float ran1_generic(int *iy, int *iv, int *idum);
 void lcgenerator(unsigned int *seed, unsigned char reset);
+void lcgeneratorSkip(unsigned int *seed, unsigned int count); /* for rfcca */
 float ran1_original(int *idum);
 void getMeanResponse(uint       treeID,
                      Terminal  *parent,
@@ -1755,6 +1758,40 @@ void unstackFactorArrays(char mode);
 void initializeFactorArrays(char mode);
 char stackMissingArrays(char mode);
 void unstackMissingArrays(char mode);
+void stackCCAWorkspace(char mode);
+void unstackCCAWorkspace(char mode);
+void resetCCAWorkspace(void);
+void unstackCCAStart(Node *parent);
+void stackCCAPermutation(char mode);
+void unstackCCAPermutation(char mode);
+void stackCCABins(char mode);
+void unstackCCABins(char mode);
+SEXP ccaAppendProfile(SEXP output);
+void ccaBinSort(uint    treeID,
+                uint    covariate,
+                uint   *repMembrIndx,
+                uint   *nonMissMembrIndx,
+                uint    nonMissMembrSize,
+                uint   *indxx,
+                double *splitVector,
+                uint   *splitVectorSize);
+void stackCCAPresort(char mode);
+void unstackCCAPresort(char mode);
+void ccaPresortTree(uint treeID, uint *repMembrIndx, uint repMembrSize);
+void ccaUnsortTree(uint treeID);
+void ccaPresortOrder(uint    treeID,
+                     Node   *parent,
+                     uint    covariate,
+                     uint   *repMembrIndx,
+                     uint    repMembrSize,
+                     uint   *indxx,
+                     double *splitVector,
+                     uint   *splitVectorSize);
+void ccaPresortSplit(uint  treeID,
+                     Node *parent,
+                     uint *repMembrIndx,
+                     uint  repMembrSize,
+                     char *membershipIndicator);
 void stackMissingSignatures(uint     obsSize,
                             uint     rspSize,
                             double **responsePtr,
@@ -2084,6 +2121,7 @@ SEXP rfsrcGrow(SEXP traceFlag,
                SEXP mvdata1Size,
                SEXP mvdata2Size,
                SEXP ccaData,
+               SEXP ccaSplit,
                SEXP xSize,
                SEXP xType,
                SEXP xLevels,
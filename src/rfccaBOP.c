@@ -0,0 +1,232 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <Rdefines.h>
+
+#include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+  Bags of Observations for Prediction (BOPs)
+
+  The BOP of an observation is the collection of the inbag training
+  observations of the terminal nodes it falls into, over all trees,
+  each counted as many times as it is inbag.  A BOP is returned in
+  compressed form, as the increasing training rows it contains and the
+  number of times each of them is counted, instead of one entry per
+  (tree, inbag replicate) pair.
+
+  Each tree is first turned into an inverted index from terminal node
+  to its inbag members and their inbag counts, stored as one array of
+  rows per tree with the members of node k at [start[k], start[k+1]).
+  The BOPs of all requested observations are then accumulated in
+  parallel across observations.
+
+  sexp_n          - number of training observations.
+  sexp_ntree      - number of trees.
+  sexp_membership - n x ntree terminal node membership of the training data.
+  sexp_inbag      - n x ntree inbag counts of the training data.
+  sexp_test       - m x ntree terminal node membership of the observations
+                    whose BOPs are wanted, or NULL for the out-of-bag
+                    BOPs of the training observations.
+  sexp_numThreads - number of threads (negative for all available).
+
+  Returns a list of m BOPs, each a list with the integer vectors index
+  (1-based training rows) and weight, or NULL for an empty BOP.
+*/
+
+typedef struct rfccaLeafIndex RFCCALeafIndex;
+struct rfccaLeafIndex {
+  int  leafCount;
+  int *start;
+  int *member;
+  int *count;
+};
+
+static void makeLeafIndex(RFCCALeafIndex *index,
+                          int             n,
+                          int            *membership,
+                          int            *inbag)
+{
+  int i, k, maxNode;
+  int *fill;
+
+  maxNode = 0;
+  for (i = 0; i < n; i++) {
+    if (membership[i] > maxNode) maxNode = membership[i];
+  }
+  index -> leafCount = maxNode;
+  index -> start = (int *) R_alloc(maxNode + 2, sizeof(int));
+  for (k = 0; k <= maxNode + 1; k++) {
+    index -> start[k] = 0;
+  }
+  for (i = 0; i < n; i++) {
+    if ((inbag[i] > 0) && (membership[i] > 0)) {
+      index -> start[membership[i] + 1] ++;
+    }
+  }
+  for (k = 1; k <= maxNode + 1; k++) {
+    index -> start[k] += index -> start[k - 1];
+  }
+  index -> member = (int *) R_alloc(index -> start[maxNode + 1] + 1, sizeof(int));
+  index -> count  = (int *) R_alloc(index -> start[maxNode + 1] + 1, sizeof(int));
+  fill = (int *) R_alloc(maxNode + 1, sizeof(int));
+  for (k = 0; k <= maxNode; k++) {
+    fill[k] = index -> start[k];
+  }
+  for (i = 0; i < n; i++) {
+    if ((inbag[i] > 0) && (membership[i] > 0)) {
+      index -> member[fill[membership[i]]] = i;
+      index -> count[fill[membership[i]]] = inbag[i];
+      fill[membership[i]] ++;
+    }
+  }
+}
+
+// Terminal node of observation obs in tree, or zero when the tree does
+// not contribute to its BOP.
+static int bopNode(int             obs,
+                   int             tree,
+                   int             n,
+                   int             m,
+                   int            *membership,
+                   int            *inbag,
+                   int            *test,
+                   RFCCALeafIndex *index)
+{
+  int node;
+
+  if (test == NULL) {
+    if (inbag[obs + tree * n] > 0) return 0;
+    node = membership[obs + tree * n];
+  }
+  else {
+    node = test[obs + tree * m];
+  }
+  if ((node < 1) || (node > index[tree].leafCount)) return 0;
+  return node;
+}
+
+static int compareRow(const void *a, const void *b)
+{
+  int x = *((const int *) a), y = *((const int *) b);
+  return (x > y) - (x < y);
+}
+
+SEXP rfccaBOP(SEXP sexp_n,
+              SEXP sexp_ntree,
+              SEXP sexp_membership,
+              SEXP sexp_inbag,
+              SEXP sexp_test,
+              SEXP sexp_numThreads)
+{
+  int  n          = INTEGER(sexp_n)[0];
+  int  ntree      = INTEGER(sexp_ntree)[0];
+  int *membership = INTEGER(sexp_membership);
+  int *inbag      = INTEGER(sexp_inbag);
+  int *test       = NULL;
+  int  numThreads = 1;
+  int  m, obs, tree, k;
+  size_t i;
+  RFCCALeafIndex *index;
+  int  *bopSize;
+  int **bopIndex;
+  int **bopWeight;
+  int  *weight, *touched;
+  SEXP out, names, bop;
+
+  m = n;
+  if (sexp_test != R_NilValue) {
+    test = INTEGER(sexp_test);
+    m    = LENGTH(sexp_test) / ntree;
+  }
+#ifdef _OPENMP
+  numThreads = INTEGER(sexp_numThreads)[0];
+  if (numThreads < 0) {
+    numThreads = omp_get_max_threads();
+  }
+  else {
+    numThreads = (numThreads < omp_get_max_threads()) ? (numThreads) : (omp_get_max_threads());
+  }
+  if (numThreads < 1) numThreads = 1;
+#endif
+
+  index = (RFCCALeafIndex *) R_alloc(ntree, sizeof(RFCCALeafIndex));
+  for (tree = 0; tree < ntree; tree++) {
+    makeLeafIndex(index + tree, n, membership + (R_xlen_t) tree * n, inbag + (R_xlen_t) tree * n);
+  }
+
+  // Dense per-thread accumulators of the weights of the training rows.
+  weight  = (int *) R_alloc((size_t) numThreads * n, sizeof(int));
+  touched = (int *) R_alloc((size_t) numThreads * n, sizeof(int));
+  for (i = 0; i < (size_t) numThreads * n; i++) {
+    weight[i] = 0;
+  }
+  bopSize   = (int *)  R_alloc(m, sizeof(int));
+  bopIndex  = (int **) R_alloc(m, sizeof(int *));
+  bopWeight = (int **) R_alloc(m, sizeof(int *));
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(numThreads) private(tree, k)
+#endif
+  for (obs = 0; obs < m; obs++) {
+    int thread = 0;
+    int node, row, size;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+#endif
+    int *threadWeight  = weight + (size_t) thread * n;
+    int *threadTouched = touched + (size_t) thread * n;
+    size = 0;
+    for (tree = 0; tree < ntree; tree++) {
+      node = bopNode(obs, tree, n, m, membership, inbag, test, index);
+      if (node > 0) {
+        for (k = index[tree].start[node]; k < index[tree].start[node + 1]; k++) {
+          row = index[tree].member[k];
+          if (threadWeight[row] == 0) {
+            threadTouched[size ++] = row;
+          }
+          threadWeight[row] += index[tree].count[k];
+        }
+      }
+    }
+    bopSize[obs] = size;
+    bopIndex[obs] = bopWeight[obs] = NULL;
+    if (size > 0) {
+      qsort(threadTouched, size, sizeof(int), compareRow);
+      bopIndex[obs]  = (int *) malloc(size * sizeof(int));
+      bopWeight[obs] = (int *) malloc(size * sizeof(int));
+      for (k = 0; k < size; k++) {
+        row = threadTouched[k];
+        bopIndex[obs][k]  = row + 1;
+        bopWeight[obs][k] = threadWeight[row];
+        threadWeight[row] = 0;
+      }
+    }
+  }
+
+  // R objects cannot be allocated from the threads.
+  PROTECT(out = allocVector(VECSXP, m));
+  PROTECT(names = allocVector(STRSXP, 2));
+  SET_STRING_ELT(names, 0, mkChar("index"));
+  SET_STRING_ELT(names, 1, mkChar("weight"));
+  for (obs = 0; obs < m; obs++) {
+    if (bopSize[obs] > 0) {
+      bop = allocVector(VECSXP, 2);
+      SET_VECTOR_ELT(out, obs, bop);
+      setAttrib(bop, R_NamesSymbol, names);
+      SET_VECTOR_ELT(bop, 0, allocVector(INTSXP, bopSize[obs]));
+      SET_VECTOR_ELT(bop, 1, allocVector(INTSXP, bopSize[obs]));
+      for (k = 0; k < bopSize[obs]; k++) {
+        INTEGER(VECTOR_ELT(bop, 0))[k] = bopIndex[obs][k];
+        INTEGER(VECTOR_ELT(bop, 1))[k] = bopWeight[obs][k];
+      }
+      free(bopIndex[obs]);
+      free(bopWeight[obs]);
+    }
+  }
+
+  UNPROTECT(2);
+  return out;
+}
@@ -0,0 +1,769 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <Rdefines.h>
+
+#include <stdlib.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <R_ext/Lapack.h>
+#include <R_ext/BLAS.h>
+
+#ifndef FCONE
+# define FCONE
+#endif
+
+#include "rfccaThreads.h"
+#include "rfccaLeafStat.h"
+
+/*
+  Final CCA Estimation of the BOPs
+
+  For every BOP the first canonical correlation and the first pair of
+  canonical coefficient vectors are computed as stats::cancor() does
+  for the BOP with its rows replicated by their weights, that is on the
+  weighted column-centered rows scaled by the square root of their
+  weights:  X and Y are QR factored, the singular value decomposition
+  of Qx'Qy gives the correlation and the singular vectors u and v, and
+  the coefficients solve Rx a = u and Ry b = v.  The pair is then
+  signed by rfccaSignEstimate(), as the estimates from the terminal node
+  statistics are, so the coefficients are those of cancor() up to their
+  common sign.
+
+  cancor() pivots the columns of a rank deficient X or Y, with a rule
+  that is not reproduced here.  Such BOPs are flagged in the returned
+  status and left to the R code.
+
+  The BOPs are processed in parallel, each with its own scratch space,
+  and the threads of a multithreaded BLAS are budgeted against them
+  (see rfccaThreads.c).
+
+  sexp_bop        - list of BOPs, each a list with the integer vectors
+                    index (1-based training rows) and weight, or NULL.
+  sexp_x, sexp_y  - the n x px and n x py training data.
+  sexp_numThreads - number of threads (negative for all available).
+
+  Returns a list with estimate, the (1 + px + py) x m matrix of the
+  correlation followed by the X and Y coefficients of each BOP, and
+  status, which is 0 when the column of estimate is set, 1 for an
+  empty BOP and 2 for a BOP left to the R code.
+*/
+
+#define RFCCA_QR_TOL 1.0e-7
+
+// Weighted centering of the rows index of the n x p matrix data, scaled
+// by the square root of their weight, into the nb x p matrix a.
+static void bopWeightedBlock(double *data,
+                             int     n,
+                             int     p,
+                             int    *index,
+                             int    *weight,
+                             int     nb,
+                             double *a)
+{
+  int i, j;
+  double sum, mean, total;
+
+  total = 0.0;
+  for (i = 0; i < nb; i++) total += weight[i];
+  for (j = 0; j < p; j++) {
+    sum = 0.0;
+    for (i = 0; i < nb; i++) {
+      sum += weight[i] * data[(index[i] - 1) + (size_t) j * n];
+    }
+    mean = sum / total;
+    for (i = 0; i < nb; i++) {
+      a[i + (size_t) j * nb] = sqrt((double) weight[i]) * (data[(index[i] - 1) + (size_t) j * n] - mean);
+    }
+  }
+}
+
+// QR factorization of the nb x p matrix a in place, with the thin Q in
+// q and the triangular factor left in the upper triangle of a.  Returns
+// zero when a column falls below RFCCA_QR_TOL times its original norm.
+static int bopQR(int nb, int p, double *a, double *q, double *tau, double *work, int lwork)
+{
+  int i, j, info, incr = 1;
+  double norm;
+  double *colNorm = work + lwork;
+
+  for (j = 0; j < p; j++) {
+    colNorm[j] = F77_CALL(dnrm2)(&nb, a + (size_t) j * nb, &incr);
+    if (colNorm[j] == 0.0) colNorm[j] = 1.0;
+  }
+  F77_CALL(dgeqrf)(&nb, &p, a, &nb, tau, work, &lwork, &info);
+  if (info != 0) return 0;
+  for (j = 0; j < p; j++) {
+    norm = fabs(a[j + (size_t) j * nb]);
+    if (norm < RFCCA_QR_TOL * colNorm[j]) return 0;
+  }
+  for (j = 0; j < p; j++) {
+    for (i = 0; i < nb; i++) {
+      q[i + (size_t) j * nb] = a[i + (size_t) j * nb];
+    }
+  }
+  F77_CALL(dorgqr)(&nb, &p, &p, q, &nb, tau, work, &lwork, &info);
+  return (info == 0);
+}
+
+static int bopEstimate(double *x,
+                       double *y,
+                       int     n,
+                       int     px,
+                       int     py,
+                       int    *index,
+                       int    *weight,
+                       int     nb,
+                       double *estimate)
+{
+  char transa = 'T', transb = 'N';
+  char side = 'L', uplo = 'U', diag = 'N';
+  char jobz;
+  double alpha = 1.0, beta = 0.0, query;
+  int minDim = (px < py) ? px : py;
+  int maxDim = (px < py) ? py : px;
+  int lwork, query_lwork = -1, info, ldvt, one = 1;
+  int j, status;
+
+  if ((nb < px) || (nb < py)) {
+    return RFCCA_EST_RANK;
+  }
+
+  double *ax  = (double *) malloc(sizeof(double) * ((size_t) nb * px));
+  double *ay  = (double *) malloc(sizeof(double) * ((size_t) nb * py));
+  double *qx  = (double *) malloc(sizeof(double) * ((size_t) nb * px));
+  double *qy  = (double *) malloc(sizeof(double) * ((size_t) nb * py));
+  double *tau = (double *) malloc(sizeof(double) * maxDim);
+  double *m   = (double *) malloc(sizeof(double) * ((size_t) px * py));
+  double *s   = (double *) malloc(sizeof(double) * minDim);
+  double *u   = (double *) malloc(sizeof(double) * ((size_t) px * px));
+  double *vt  = (double *) malloc(sizeof(double) * ((size_t) py * py));
+  int    *iwork = (int *) malloc(sizeof(int) * 8 * minDim);
+  double *work;
+
+  // svd(M, nu = px, nv = py) computes all singular vectors unless M is
+  // square, and so does this.
+  jobz = (px == py) ? 'S' : 'A';
+  ldvt = (jobz == 'S') ? minDim : py;
+
+  F77_CALL(dgeqrf)(&nb, &maxDim, ax, &nb, tau, &query, &query_lwork, &info);
+  lwork = (int) query;
+  F77_CALL(dorgqr)(&nb, &maxDim, &maxDim, qx, &nb, tau, &query, &query_lwork, &info);
+  if ((int) query > lwork) lwork = (int) query;
+  F77_CALL(dgesdd)(&jobz, &px, &py, m, &px, s, u, &px, vt, &ldvt, &query, &query_lwork, iwork, &info FCONE);
+  if ((int) query > lwork) lwork = (int) query;
+  if (lwork < 1) lwork = 1;
+  // The column norms are kept past the end of the work array.
+  work = (double *) malloc(sizeof(double) * (lwork + maxDim));
+
+  status = RFCCA_EST_RANK;
+  bopWeightedBlock(x, n, px, index, weight, nb, ax);
+  bopWeightedBlock(y, n, py, index, weight, nb, ay);
+  if (bopQR(nb, px, ax, qx, tau, work, lwork) && bopQR(nb, py, ay, qy, tau, work, lwork)) {
+    F77_CALL(dgemm)(&transa, &transb, &px, &py, &nb, &alpha, qx, &nb, qy, &nb, &beta, m, &px FCONE FCONE);
+    F77_CALL(dgesdd)(&jobz, &px, &py, m, &px, s, u, &px, vt, &ldvt, work, &lwork, iwork, &info FCONE);
+    if (info == 0) {
+      // a = backsolve(Rx, u[, 1]) and b = backsolve(Ry, v[, 1]).
+      for (j = 0; j < py; j++) {
+        m[j] = vt[(size_t) j * ldvt];
+      }
+      F77_CALL(dtrsm)(&side, &uplo, &transb, &diag, &px, &one, &alpha, ax, &nb, u, &px FCONE FCONE FCONE FCONE);
+      F77_CALL(dtrsm)(&side, &uplo, &transb, &diag, &py, &one, &alpha, ay, &nb, m, &py FCONE FCONE FCONE FCONE);
+      estimate[0] = s[0];
+      for (j = 0; j < px; j++) estimate[1 + j] = u[j];
+      for (j = 0; j < py; j++) estimate[1 + px + j] = m[j];
+      rfccaSignEstimate(estimate, px, py);
+      status = RFCCA_EST_OK;
+    }
+  }
+
+  free(ax); free(ay); free(qx); free(qy); free(tau);
+  free(m); free(s); free(u); free(vt); free(iwork); free(work);
+  return status;
+}
+
+// Number of threads for the estimation of m BOPs.  The threads of a
+// multithreaded BLAS are budgeted against them, and the previous number
+// of BLAS threads, to be restored afterwards, is returned in blasThreads.
+static int estimateThreads(SEXP sexp_numThreads, int m, int *blasThreads)
+{
+  int numThreads = 1;
+
+  *blasThreads = 0;
+#ifdef _OPENMP
+  numThreads = INTEGER(sexp_numThreads)[0];
+  if (numThreads < 0) {
+    numThreads = omp_get_max_threads();
+  }
+  else {
+    numThreads = (numThreads < omp_get_max_threads()) ? (numThreads) : (omp_get_max_threads());
+  }
+  if (numThreads < 1) numThreads = 1;
+  // Each BOP is estimated with a serial BLAS, unless there are fewer
+  // BOPs than threads.
+  *blasThreads = rfccaBlasGetThreads();
+  rfccaBlasSetThreads(rfccaThreadBudget(&numThreads, m, RFCCA_BLAS_AUTO));
+#endif
+  return numThreads;
+}
+
+// The BOPs are unpacked before the threads start, since R objects may
+// only be accessed from the main thread.
+static void estimateUnpack(SEXP sexp_bop, int m, int ***bopIndex, int ***bopWeight, int **bopSize)
+{
+  int obs;
+
+  *bopIndex  = (int **) R_alloc(m, sizeof(int *));
+  *bopWeight = (int **) R_alloc(m, sizeof(int *));
+  *bopSize   = (int *)  R_alloc(m, sizeof(int));
+  for (obs = 0; obs < m; obs++) {
+    SEXP bop = VECTOR_ELT(sexp_bop, obs);
+    (*bopSize)[obs] = 0;
+    if (bop != R_NilValue) {
+      (*bopIndex)[obs]  = INTEGER(VECTOR_ELT(bop, 0));
+      (*bopWeight)[obs] = INTEGER(VECTOR_ELT(bop, 1));
+      (*bopSize)[obs]   = LENGTH(VECTOR_ELT(bop, 0));
+    }
+  }
+}
+
+SEXP rfccaEstimate(SEXP sexp_bop,
+                   SEXP sexp_x,
+                   SEXP sexp_y,
+                   SEXP sexp_n,
+                   SEXP sexp_px,
+                   SEXP sexp_py,
+                   SEXP sexp_numThreads)
+{
+  int     n  = INTEGER(sexp_n)[0];
+  int     px = INTEGER(sexp_px)[0];
+  int     py = INTEGER(sexp_py)[0];
+  double *x  = REAL(sexp_x);
+  double *y  = REAL(sexp_y);
+  int     m  = LENGTH(sexp_bop);
+  int     numThreads, blasThreads;
+  int     obs, j;
+  int   **bopIndex, **bopWeight, *bopSize;
+  double *estimate;
+  int    *status;
+  SEXP    out, names, sexp_estimate, sexp_status;
+
+  numThreads = estimateThreads(sexp_numThreads, m, &blasThreads);
+
+  PROTECT(out = allocVector(VECSXP, 2));
+  PROTECT(names = allocVector(STRSXP, 2));
+  SET_STRING_ELT(names, 0, mkChar("estimate"));
+  SET_STRING_ELT(names, 1, mkChar("status"));
+  setAttrib(out, R_NamesSymbol, names);
+  SET_VECTOR_ELT(out, 0, sexp_estimate = allocMatrix(REALSXP, 1 + px + py, m));
+  SET_VECTOR_ELT(out, 1, sexp_status = allocVector(INTSXP, m));
+  estimate = REAL(sexp_estimate);
+  status = INTEGER(sexp_status);
+
+  estimateUnpack(sexp_bop, m, &bopIndex, &bopWeight, &bopSize);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(numThreads) schedule(dynamic) private(j)
+#endif
+  for (obs = 0; obs < m; obs++) {
+    double *column = estimate + (size_t) obs * (1 + px + py);
+    for (j = 0; j < 1 + px + py; j++) {
+      column[j] = NA_REAL;
+    }
+    if (bopSize[obs] == 0) {
+      status[obs] = RFCCA_EST_EMPTY;
+    }
+    else {
+      status[obs] = bopEstimate(x, y, n, px, py, bopIndex[obs], bopWeight[obs], bopSize[obs], column);
+    }
+  }
+  if (blasThreads > 0) {
+    rfccaBlasSetThreads(blasThreads);
+  }
+
+  UNPROTECT(2);
+  return out;
+}
+
+/*
+  Regularized and Sparse CCA Estimation of the BOPs
+
+  Both estimators only use a BOP through its weighted cross-product
+  matrices Cxx = X'WX, Cyy = Y'WY and Cxy = X'WY of the weighted
+  column-centered rows, which are formed once per BOP.
+
+  Regularized CCA is CCA::rcc() for the BOP with its rows replicated by
+  their weights:  with Sxx = Cxx / (w - 1) + lambda1 I, Syy likewise and
+  Sxy = Cxy / (w - 1), for w the total weight, the correlation is the
+  largest singular value of Sxx^(-1/2) Sxy Syy^(-1/2) and the coefficients
+  are Sxx^(-1/2) u and Syy^(-1/2) v for its singular vectors.  With the
+  eigendecompositions Cxx / (w - 1) = Ux Dx Ux' and Cyy / (w - 1) = Uy Dy
+  Uy', computed once per BOP, this is the SVD of the px x py matrix
+
+      (Dx + lambda1 I)^(-1/2) Ux' Sxy Uy (Dy + lambda2 I)^(-1/2),
+
+  so every pair of a grid of lambda1 and lambda2 values only costs a
+  scaling and a small SVD.  The coefficients are signed by
+  rfccaSignEstimate(), as those of cca are.  A pair for which
+  Sxx or Syy is not positive definite gives NA.
+
+  Sparse CCA is PMA::CCA() with standard penalties for the weighted BOP
+  standardized by its weighted standard deviations, whose cross-product
+  matrix is Cxy scaled by these.  Starting from the first right singular
+  vector v of this matrix, the penalized alternating updates of u and v
+  follow PMA's, with fixed penalties RFCCA_SCCA_PENALTY times the square
+  root of the number of X and Y variables with nonzero variance.  The
+  coefficients of the other variables are zero.  The correlation is the
+  weighted correlation of X u and Y v of the standardized BOP, and zero
+  when u or v is zero.
+*/
+
+#define RFCCA_SCCA_PENALTY 0.3
+#define RFCCA_SCCA_NITER   15
+
+// The weighted cross-product matrices of a BOP.  Returns the total weight.
+static double bopGram(double *x,
+                      double *y,
+                      int     n,
+                      int     px,
+                      int     py,
+                      int    *index,
+                      int    *weight,
+                      int     nb,
+                      double *cxx,
+                      double *cyy,
+                      double *cxy)
+{
+  char transa = 'T', transb = 'N';
+  double alpha = 1.0, beta = 0.0, total = 0.0;
+  int i;
+
+  double *ax = (double *) malloc(sizeof(double) * ((size_t) nb * px));
+  double *ay = (double *) malloc(sizeof(double) * ((size_t) nb * py));
+  bopWeightedBlock(x, n, px, index, weight, nb, ax);
+  bopWeightedBlock(y, n, py, index, weight, nb, ay);
+  F77_CALL(dgemm)(&transa, &transb, &px, &px, &nb, &alpha, ax, &nb, ax, &nb, &beta, cxx, &px FCONE FCONE);
+  F77_CALL(dgemm)(&transa, &transb, &py, &py, &nb, &alpha, ay, &nb, ay, &nb, &beta, cyy, &py FCONE FCONE);
+  F77_CALL(dgemm)(&transa, &transb, &px, &py, &nb, &alpha, ax, &nb, ay, &nb, &beta, cxy, &px FCONE FCONE);
+  free(ax); free(ay);
+  for (i = 0; i < nb; i++) total += weight[i];
+  return total;
+}
+
+// Workspace size of dgesdd() for the first singular vectors of a
+// p x q matrix.
+static int svdWork(int p, int q)
+{
+  char jobz = 'S';
+  int minDim = (p < q) ? p : q;
+  int query_lwork = -1, info;
+  double query, dummy;
+  int idummy;
+
+  F77_CALL(dgesdd)(&jobz, &p, &q, &dummy, &p, &dummy, &dummy, &p, &dummy, &minDim, &query, &query_lwork, &idummy, &info FCONE);
+  return ((int) query > 1) ? (int) query : 1;
+}
+
+static void bopRegularized(double *x,
+                           double *y,
+                           int     n,
+                           int     px,
+                           int     py,
+                           int    *index,
+                           int    *weight,
+                           int     nb,
+                           double *lambda1,
+                           int     nlambda1,
+                           double *lambda2,
+                           int     nlambda2,
+                           double *estimate,
+                           size_t  stride)
+{
+  char jobv = 'V', uplo = 'U', jobz = 'S';
+  char transa = 'T', transb = 'N';
+  double alpha = 1.0, beta = 0.0, query, scale;
+  int minDim = (px < py) ? px : py;
+  int maxDim = (px < py) ? py : px;
+  int lwork, svdLwork, query_lwork = -1, info, one = 1;
+  int i, j, g, h, ok;
+  double total;
+
+  double *cxx = (double *) malloc(sizeof(double) * ((size_t) px * px));
+  double *cyy = (double *) malloc(sizeof(double) * ((size_t) py * py));
+  double *cxy = (double *) malloc(sizeof(double) * ((size_t) px * py));
+  double *dx  = (double *) malloc(sizeof(double) * px);
+  double *dy  = (double *) malloc(sizeof(double) * py);
+  double *rx  = (double *) malloc(sizeof(double) * px);
+  double *ry  = (double *) malloc(sizeof(double) * py);
+  double *tmp = (double *) malloc(sizeof(double) * ((size_t) px * py + px + py));
+  double *mxy = (double *) malloc(sizeof(double) * ((size_t) px * py));
+  double *k   = (double *) malloc(sizeof(double) * ((size_t) px * py));
+  double *s   = (double *) malloc(sizeof(double) * minDim);
+  double *u   = (double *) malloc(sizeof(double) * ((size_t) px * minDim));
+  double *vt  = (double *) malloc(sizeof(double) * ((size_t) minDim * py));
+  int    *iwork = (int *) malloc(sizeof(int) * 8 * minDim);
+  double *work;
+
+  F77_CALL(dsyev)(&jobv, &uplo, &maxDim, cxx, &maxDim, dx, &query, &query_lwork, &info FCONE FCONE);
+  lwork = (int) query;
+  svdLwork = svdWork(px, py);
+  if (svdLwork > lwork) lwork = svdLwork;
+  if (lwork < 3 * maxDim) lwork = 3 * maxDim;
+  work = (double *) malloc(sizeof(double) * lwork);
+
+  total = bopGram(x, y, n, px, py, index, weight, nb, cxx, cyy, cxy);
+  ok = (total > 1.0);
+  if (ok) {
+    scale = 1.0 / (total - 1.0);
+    for (i = 0; i < px * px; i++) cxx[i] *= scale;
+    for (i = 0; i < py * py; i++) cyy[i] *= scale;
+    for (i = 0; i < px * py; i++) cxy[i] *= scale;
+    // Eigenvectors overwrite cxx and cyy.
+    F77_CALL(dsyev)(&jobv, &uplo, &px, cxx, &px, dx, work, &lwork, &info FCONE FCONE);
+    ok = (info == 0);
+  }
+  if (ok) {
+    F77_CALL(dsyev)(&jobv, &uplo, &py, cyy, &py, dy, work, &lwork, &info FCONE FCONE);
+    ok = (info == 0);
+  }
+  if (ok) {
+    // mxy = Ux' Sxy Uy.
+    F77_CALL(dgemm)(&transb, &transb, &px, &py, &py, &alpha, cxy, &px, cyy, &py, &beta, tmp, &px FCONE FCONE);
+    F77_CALL(dgemm)(&transa, &transb, &px, &py, &px, &alpha, cxx, &px, tmp, &px, &beta, mxy, &px FCONE FCONE);
+  }
+  for (h = 0; h < nlambda2; h++) {
+    for (g = 0; g < nlambda1; g++) {
+      double *column = estimate + (size_t) (g + h * nlambda1) * stride;
+      int pd = ok;
+      for (j = 0; j < 1 + px + py; j++) {
+        column[j] = NA_REAL;
+      }
+      for (i = 0; pd && (i < px); i++) {
+        pd = (dx[i] + lambda1[g] > 0.0);
+        if (pd) rx[i] = 1.0 / sqrt(dx[i] + lambda1[g]);
+      }
+      for (j = 0; pd && (j < py); j++) {
+        pd = (dy[j] + lambda2[h] > 0.0);
+        if (pd) ry[j] = 1.0 / sqrt(dy[j] + lambda2[h]);
+      }
+      if (!pd) continue;
+      for (j = 0; j < py; j++) {
+        for (i = 0; i < px; i++) {
+          k[i + (size_t) j * px] = rx[i] * mxy[i + (size_t) j * px] * ry[j];
+        }
+      }
+      F77_CALL(dgesdd)(&jobz, &px, &py, k, &px, s, u, &px, vt, &minDim, work, &lwork, iwork, &info FCONE);
+      if (info != 0) continue;
+      // a = Ux (Dx + lambda1 I)^(-1/2) u[, 1], b likewise.
+      for (i = 0; i < px; i++) tmp[i] = rx[i] * u[i];
+      for (j = 0; j < py; j++) tmp[px + j] = ry[j] * vt[(size_t) j * minDim];
+      F77_CALL(dgemv)(&transb, &px, &px, &alpha, cxx, &px, tmp, &one, &beta, column + 1, &one FCONE);
+      F77_CALL(dgemv)(&transb, &py, &py, &alpha, cyy, &py, tmp + px, &one, &beta, column + 1 + px, &one FCONE);
+      rfccaSignEstimate(column, px, py);
+      column[0] = s[0];
+    }
+  }
+
+  free(cxx); free(cyy); free(cxy); free(dx); free(dy); free(rx); free(ry);
+  free(tmp); free(mxy); free(k); free(s); free(u); free(vt); free(iwork); free(work);
+}
+
+// The L2 norm as PMA computes it, with 0.05 for a zero vector.
+static double sccaNorm(double *a, int p)
+{
+  int i;
+  double sum = 0.0;
+  for (i = 0; i < p; i++) sum += a[i] * a[i];
+  return (sum == 0.0) ? 0.05 : sqrt(sum);
+}
+
+// Soft thresholding of a by lambda into s.
+static void sccaSoft(double *a, int p, double lambda, double *s)
+{
+  int i;
+  for (i = 0; i < p; i++) {
+    s[i] = (fabs(a[i]) > lambda) ? ((a[i] > 0.0) ? (a[i] - lambda) : (a[i] + lambda)) : 0.0;
+  }
+}
+
+// The threshold for which the L1 norm of the normalized thresholded a
+// is sumabs, found by bisection as PMA's BinarySearch() does.
+static double sccaSearch(double *a, int p, double sumabs, double *s)
+{
+  int i, iter;
+  double norm, sum, lam1, lam2, mid;
+
+  norm = sccaNorm(a, p);
+  sum = 0.0;
+  for (i = 0; i < p; i++) sum += fabs(a[i] / norm);
+  if (sum <= sumabs) return 0.0;
+  lam1 = 0.0;
+  lam2 = 0.0;
+  for (i = 0; i < p; i++) {
+    if (fabs(a[i]) > lam2) lam2 = fabs(a[i]);
+  }
+  lam2 -= 1.0e-5;
+  for (iter = 1; iter < 150; iter++) {
+    mid = (lam1 + lam2) / 2.0;
+    sccaSoft(a, p, mid, s);
+    norm = sccaNorm(s, p);
+    sum = 0.0;
+    for (i = 0; i < p; i++) sum += fabs(s[i] / norm);
+    if (sum < sumabs) {
+      lam2 = mid;
+    }
+    else {
+      lam1 = mid;
+    }
+    if ((lam2 - lam1) < 1.0e-6) return (lam1 + lam2) / 2.0;
+  }
+  return (lam1 + lam2) / 2.0;
+}
+
+// One penalized update b = S(M a, lambda) / ||S(M a, lambda)|| of PMA,
+// with M the p x q matrix m, transposed when trans is 'T'.
+static void sccaUpdate(char trans, int p, int q, double *m, double *a, double sumabs, double *arg, double *s, double *b)
+{
+  double alpha = 1.0, beta = 0.0, norm;
+  int i, one = 1, len = (trans == 'T') ? q : p;
+
+  F77_CALL(dgemv)(&trans, &p, &q, &alpha, m, &p, a, &one, &beta, arg, &one FCONE);
+  sccaSoft(arg, len, sccaSearch(arg, len, sumabs, s), s);
+  norm = sccaNorm(s, len);
+  for (i = 0; i < len; i++) b[i] = s[i] / norm;
+}
+
+// Quadratic form a' M b of the p x q matrix m.
+static double sccaForm(int p, int q, double *a, double *m, double *b)
+{
+  int i, j;
+  double sum = 0.0;
+  for (j = 0; j < q; j++) {
+    for (i = 0; i < p; i++) {
+      sum += a[i] * m[i + (size_t) j * p] * b[j];
+    }
+  }
+  return sum;
+}
+
+static void bopSparse(double *x,
+                      double *y,
+                      int     n,
+                      int     px,
+                      int     py,
+                      int    *index,
+                      int    *weight,
+                      int     nb,
+                      double *estimate)
+{
+  char jobz = 'S';
+  int minDim = (px < py) ? px : py;
+  int maxDim = (px < py) ? py : px;
+  int lwork, info, iter, i, j, qx, qy, started;
+  double total, change, su, sv, cor;
+
+  double *cxx = (double *) malloc(sizeof(double) * ((size_t) px * px));
+  double *cyy = (double *) malloc(sizeof(double) * ((size_t) py * py));
+  double *cxy = (double *) malloc(sizeof(double) * ((size_t) px * py));
+  double *sdx = (double *) malloc(sizeof(double) * px);
+  double *sdy = (double *) malloc(sizeof(double) * py);
+  double *k   = (double *) malloc(sizeof(double) * ((size_t) px * py));
+  double *s   = (double *) malloc(sizeof(double) * minDim);
+  double *uu  = (double *) malloc(sizeof(double) * ((size_t) px * minDim));
+  double *vt  = (double *) malloc(sizeof(double) * ((size_t) minDim * py));
+  double *u   = (double *) malloc(sizeof(double) * px);
+  double *v   = (double *) malloc(sizeof(double) * py);
+  double *vold = (double *) malloc(sizeof(double) * py);
+  double *arg = (double *) malloc(sizeof(double) * maxDim);
+  double *soft = (double *) malloc(sizeof(double) * maxDim);
+  int    *iwork = (int *) malloc(sizeof(int) * 8 * minDim);
+  double *work;
+
+  lwork = svdWork(px, py);
+  work = (double *) malloc(sizeof(double) * lwork);
+
+  for (j = 0; j < 1 + px + py; j++) {
+    estimate[j] = NA_REAL;
+  }
+  total = bopGram(x, y, n, px, py, index, weight, nb, cxx, cyy, cxy);
+  if (total > 1.0) {
+    // Weighted standard deviations, the variables with none drop out.
+    qx = qy = 0;
+    for (i = 0; i < px; i++) {
+      sdx[i] = sqrt(cxx[i + (size_t) i * px] / (total - 1.0));
+      if (sdx[i] > 0.0) qx++;
+      sdx[i] = (sdx[i] > 0.0) ? (1.0 / sdx[i]) : 0.0;
+    }
+    for (j = 0; j < py; j++) {
+      sdy[j] = sqrt(cyy[j + (size_t) j * py] / (total - 1.0));
+      if (sdy[j] > 0.0) qy++;
+      sdy[j] = (sdy[j] > 0.0) ? (1.0 / sdy[j]) : 0.0;
+    }
+    for (j = 0; j < px; j++) {
+      for (i = 0; i < px; i++) cxx[i + (size_t) j * px] *= sdx[i] * sdx[j];
+    }
+    for (j = 0; j < py; j++) {
+      for (i = 0; i < py; i++) cyy[i + (size_t) j * py] *= sdy[i] * sdy[j];
+    }
+    for (j = 0; j < py; j++) {
+      for (i = 0; i < px; i++) {
+        cxy[i + (size_t) j * px] *= sdx[i] * sdy[j];
+        k[i + (size_t) j * px] = cxy[i + (size_t) j * px];
+      }
+    }
+    su = RFCCA_SCCA_PENALTY * sqrt((double) qx);
+    sv = RFCCA_SCCA_PENALTY * sqrt((double) qy);
+    F77_CALL(dgesdd)(&jobz, &px, &py, k, &px, s, uu, &px, vt, &minDim, work, &lwork, iwork, &info FCONE);
+    if (info == 0) {
+      for (j = 0; j < py; j++) v[j] = vt[(size_t) j * minDim];
+      for (j = 0; j < py; j++) vold[j] = v[j];
+      for (i = 0; i < px; i++) u[i] = 0.0;
+      started = FALSE;
+      for (iter = 0; iter < RFCCA_SCCA_NITER; iter++) {
+        change = 0.0;
+        for (j = 0; j < py; j++) change += fabs(vold[j] - v[j]);
+        if (started && (change <= 1.0e-6)) break;
+        sccaUpdate('N', px, py, cxy, v, su, arg, soft, u);
+        for (j = 0; j < py; j++) vold[j] = v[j];
+        sccaUpdate('T', px, py, cxy, u, sv, arg, soft, v);
+        started = TRUE;
+      }
+      cor = 0.0;
+      if ((sccaForm(px, px, u, cxx, u) > 0.0) && (sccaForm(py, py, v, cyy, v) > 0.0)) {
+        cor = sccaForm(px, py, u, cxy, v) / sqrt(sccaForm(px, px, u, cxx, u) * sccaForm(py, py, v, cyy, v));
+      }
+      estimate[0] = cor;
+      for (i = 0; i < px; i++) estimate[1 + i] = u[i];
+      for (j = 0; j < py; j++) estimate[1 + px + j] = v[j];
+    }
+  }
+
+  free(cxx); free(cyy); free(cxy); free(sdx); free(sdy); free(k); free(s); free(uu); free(vt);
+  free(u); free(v); free(vold); free(arg); free(soft); free(iwork); free(work);
+}
+
+/*
+  sexp_bop, sexp_x, sexp_y, sexp_n, sexp_px, sexp_py and sexp_numThreads
+  are as for rfccaEstimate.
+  sexp_lambda1    - the lambda1 values of the grid.
+  sexp_lambda2    - the lambda2 values of the grid.
+
+  Returns the (1 + px + py) x (m * nlambda1 * nlambda2) matrix of the
+  estimates of the BOPs for each pair of the grid, that is m columns for
+  each pair, with lambda1 varying fastest.  Empty BOPs give NA.
+*/
+SEXP rfccaEstimateRegularized(SEXP sexp_bop,
+                              SEXP sexp_x,
+                              SEXP sexp_y,
+                              SEXP sexp_n,
+                              SEXP sexp_px,
+                              SEXP sexp_py,
+                              SEXP sexp_lambda1,
+                              SEXP sexp_lambda2,
+                              SEXP sexp_numThreads)
+{
+  int     n  = INTEGER(sexp_n)[0];
+  int     px = INTEGER(sexp_px)[0];
+  int     py = INTEGER(sexp_py)[0];
+  double *x  = REAL(sexp_x);
+  double *y  = REAL(sexp_y);
+  int     m  = LENGTH(sexp_bop);
+  double *lambda1 = REAL(sexp_lambda1);
+  double *lambda2 = REAL(sexp_lambda2);
+  int     nlambda1 = LENGTH(sexp_lambda1);
+  int     nlambda2 = LENGTH(sexp_lambda2);
+  size_t  stride = (size_t) m * (1 + px + py);
+  int     numThreads, blasThreads;
+  int     obs, g, j;
+  int   **bopIndex, **bopWeight, *bopSize;
+  double *estimate;
+  SEXP    sexp_estimate;
+
+  numThreads = estimateThreads(sexp_numThreads, m, &blasThreads);
+
+  PROTECT(sexp_estimate = allocMatrix(REALSXP, 1 + px + py, m * nlambda1 * nlambda2));
+  estimate = REAL(sexp_estimate);
+
+  estimateUnpack(sexp_bop, m, &bopIndex, &bopWeight, &bopSize);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(numThreads) schedule(dynamic) private(g, j)
+#endif
+  for (obs = 0; obs < m; obs++) {
+    double *column = estimate + (size_t) obs * (1 + px + py);
+    if (bopSize[obs] == 0) {
+      for (g = 0; g < nlambda1 * nlambda2; g++) {
+        for (j = 0; j < 1 + px + py; j++) {
+          column[g * stride + j] = NA_REAL;
+        }
+      }
+    }
+    else {
+      bopRegularized(x, y, n, px, py, bopIndex[obs], bopWeight[obs], bopSize[obs],
+                     lambda1, nlambda1, lambda2, nlambda2, column, stride);
+    }
+  }
+  if (blasThreads > 0) {
+    rfccaBlasSetThreads(blasThreads);
+  }
+
+  UNPROTECT(1);
+  return sexp_estimate;
+}
+
+/*
+  The arguments are as for rfccaEstimate.
+
+  Returns the (1 + px + py) x m matrix of the sparse CCA estimates of the
+  BOPs.  Empty BOPs give NA.
+*/
+SEXP rfccaEstimateSparse(SEXP sexp_bop,
+                         SEXP sexp_x,
+                         SEXP sexp_y,
+                         SEXP sexp_n,
+                         SEXP sexp_px,
+                         SEXP sexp_py,
+                         SEXP sexp_numThreads)
+{
+  int     n  = INTEGER(sexp_n)[0];
+  int     px = INTEGER(sexp_px)[0];
+  int     py = INTEGER(sexp_py)[0];
+  double *x  = REAL(sexp_x);
+  double *y  = REAL(sexp_y);
+  int     m  = LENGTH(sexp_bop);
+  int     numThreads, blasThreads;
+  int     obs, j;
+  int   **bopIndex, **bopWeight, *bopSize;
+  double *estimate;
+  SEXP    sexp_estimate;
+
+  numThreads = estimateThreads(sexp_numThreads, m, &blasThreads);
+
+  PROTECT(sexp_estimate = allocMatrix(REALSXP, 1 + px + py, m));
+  estimate = REAL(sexp_estimate);
+
+  estimateUnpack(sexp_bop, m, &bopIndex, &bopWeight, &bopSize);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(numThreads) schedule(dynamic) private(j)
+#endif
+  for (obs = 0; obs < m; obs++) {
+    double *column = estimate + (size_t) obs * (1 + px + py);
+    if (bopSize[obs] == 0) {
+      for (j = 0; j < 1 + px + py; j++) {
+        column[j] = NA_REAL;
+      }
+    }
+    else {
+      bopSparse(x, y, n, px, py, bopIndex[obs], bopWeight[obs], bopSize[obs], column);
+    }
+  }
+  if (blasThreads > 0) {
+    rfccaBlasSetThreads(blasThreads);
+  }
+
+  UNPROTECT(1);
+  return sexp_estimate;
+}
@@ -0,0 +1,523 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <Rdefines.h>
+
+#include <stdlib.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <R_ext/Lapack.h>
+#include <R_ext/BLAS.h>
+
+#ifndef FCONE
+# define FCONE
+#endif
+
+#include "rfccaLeafStat.h"
+
+/*
+  Terminal Node Sufficient Statistics
+
+  The final CCA estimate of an observation only depends on its BOP
+  through the weighted count, the sums and the cross-products of the X
+  and Y rows it contains.  These are additive over the terminal nodes
+  the observation falls into, so they are computed once per terminal
+  node at grow time and the statistics of a new observation are summed
+  over its ntree terminal nodes, independently of the training size.
+
+  The statistics of a terminal node are a column of length
+
+    1 + px + py + px(px+1)/2 + py(py+1)/2 + px py
+
+  holding the sum of the inbag counts, the sums of X and of Y, the lower
+  triangles of X'X and Y'Y packed by columns, and X'Y stored by columns,
+  all with the rows weighted by their inbag counts.  The rows are taken
+  relative to the column means of the training data, given as center,
+  which avoids losing digits when the means are removed again.  The
+  columns of tree t are offset[t] to offset[t + 1] - 1, one per node of
+  the training membership.
+*/
+
+#define RFCCA_CHOL_TOL 1.0e-14
+
+int leafStatSize(int px, int py)
+{
+  return 1 + px + py + (px * (px + 1)) / 2 + (py * (py + 1)) / 2 + px * py;
+}
+
+// Adds the row (x, y) with weight w to the statistics column stat.
+static void leafStatAdd(double *stat, int px, int py, double *x, double *y, double w)
+{
+  int i, j;
+  double *sx  = stat + 1;
+  double *sy  = sx + px;
+  double *sxx = sy + py;
+  double *syy = sxx + (px * (px + 1)) / 2;
+  double *sxy = syy + (py * (py + 1)) / 2;
+
+  stat[0] += w;
+  for (j = 0; j < px; j++) {
+    sx[j] += w * x[j];
+    for (i = j; i < px; i++) {
+      *(sxx++) += w * x[i] * x[j];
+    }
+  }
+  for (j = 0; j < py; j++) {
+    sy[j] += w * y[j];
+    for (i = j; i < py; i++) {
+      *(syy++) += w * y[i] * y[j];
+    }
+    for (i = 0; i < px; i++) {
+      *(sxy++) += w * x[i] * y[j];
+    }
+  }
+}
+
+static int getThreadCount(SEXP sexp_numThreads)
+{
+  int numThreads = 1;
+#ifdef _OPENMP
+  numThreads = INTEGER(sexp_numThreads)[0];
+  if (numThreads < 0) {
+    numThreads = omp_get_max_threads();
+  }
+  else {
+    numThreads = (numThreads < omp_get_max_threads()) ? (numThreads) : (omp_get_max_threads());
+  }
+  if (numThreads < 1) numThreads = 1;
+#endif
+  return numThreads;
+}
+
+// Offsets of the ntree trees of the n x ntree membership in the
+// statistics, one column per node up to the largest node of the tree.
+// Returns the number of columns.
+static int leafStatOffset(int n, int ntree, int *membership, int *offset)
+{
+  int i, tree, node;
+
+  offset[0] = 0;
+  for (tree = 0; tree < ntree; tree++) {
+    node = 0;
+    for (i = 0; i < n; i++) {
+      if (membership[i + (size_t) tree * n] > node) node = membership[i + (size_t) tree * n];
+    }
+    offset[tree + 1] = offset[tree] + node;
+  }
+  return offset[ntree];
+}
+
+// Column means of the n x px and n x py training data.
+static void leafStatCenter(int n, double *x, double *y, int px, int py, double *center)
+{
+  int i, j;
+
+  for (j = 0; j < px; j++) {
+    center[j] = 0.0;
+    for (i = 0; i < n; i++) center[j] += x[i + (size_t) j * n];
+    center[j] /= n;
+  }
+  for (j = 0; j < py; j++) {
+    center[px + j] = 0.0;
+    for (i = 0; i < n; i++) center[px + j] += y[i + (size_t) j * n];
+    center[px + j] /= n;
+  }
+}
+
+// Statistics of the terminal nodes of the ntree trees, one tree per
+// thread, with rowX holding px + py doubles per thread.
+static void leafStatFill(int n, int ntree, int *membership, int *inbag,
+                         double *x, double *y, int px, int py, double *center,
+                         int *offset, double *stat, double *rowX, int numThreads)
+{
+  int statSize = leafStatSize(px, py);
+  int i, j, tree, node;
+  double *rowY;
+
+  for (i = 0; i < statSize * offset[ntree]; i++) {
+    stat[i] = 0.0;
+  }
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(numThreads) private(i, j, node, rowY) schedule(dynamic)
+#endif
+  for (tree = 0; tree < ntree; tree++) {
+    int thread = 0;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+#endif
+    double *threadX = rowX + (size_t) thread * (px + py);
+    rowY = threadX + px;
+    for (i = 0; i < n; i++) {
+      node = membership[i + (size_t) tree * n];
+      if ((inbag[i + (size_t) tree * n] > 0) && (node > 0)) {
+        for (j = 0; j < px; j++) threadX[j] = x[i + (size_t) j * n] - center[j];
+        for (j = 0; j < py; j++) rowY[j] = y[i + (size_t) j * n] - center[px + j];
+        leafStatAdd(stat + (size_t) (offset[tree] + node - 1) * statSize,
+                    px, py, threadX, rowY, (double) inbag[i + (size_t) tree * n]);
+      }
+    }
+  }
+}
+
+/*
+  sexp_n          - number of training observations.
+  sexp_ntree      - number of trees.
+  sexp_membership - n x ntree terminal node membership of the training data.
+  sexp_inbag      - n x ntree inbag counts of the training data.
+  sexp_x, sexp_y  - the n x px and n x py training data.
+  sexp_numThreads - number of threads (negative for all available).
+
+  Returns a list with stat, offset and center as described above.
+*/
+SEXP rfccaLeafStat(SEXP sexp_n,
+                   SEXP sexp_ntree,
+                   SEXP sexp_membership,
+                   SEXP sexp_inbag,
+                   SEXP sexp_x,
+                   SEXP sexp_y,
+                   SEXP sexp_px,
+                   SEXP sexp_py,
+                   SEXP sexp_numThreads)
+{
+  int     n          = INTEGER(sexp_n)[0];
+  int     ntree      = INTEGER(sexp_ntree)[0];
+  int    *membership = INTEGER(sexp_membership);
+  int    *inbag      = INTEGER(sexp_inbag);
+  double *x          = REAL(sexp_x);
+  double *y          = REAL(sexp_y);
+  int     px         = INTEGER(sexp_px)[0];
+  int     py         = INTEGER(sexp_py)[0];
+  int     numThreads = getThreadCount(sexp_numThreads);
+  int     statSize   = leafStatSize(px, py);
+  int    *offset;
+  double *center, *stat, *rowX;
+  SEXP    out, names, sexp_stat, sexp_offset, sexp_center;
+
+  PROTECT(sexp_offset = allocVector(INTSXP, ntree + 1));
+  offset = INTEGER(sexp_offset);
+  leafStatOffset(n, ntree, membership, offset);
+
+  PROTECT(out = allocVector(VECSXP, 3));
+  PROTECT(names = allocVector(STRSXP, 3));
+  SET_STRING_ELT(names, 0, mkChar("stat"));
+  SET_STRING_ELT(names, 1, mkChar("offset"));
+  SET_STRING_ELT(names, 2, mkChar("center"));
+  setAttrib(out, R_NamesSymbol, names);
+  SET_VECTOR_ELT(out, 0, sexp_stat = allocMatrix(REALSXP, statSize, offset[ntree]));
+  SET_VECTOR_ELT(out, 1, sexp_offset);
+  SET_VECTOR_ELT(out, 2, sexp_center = allocVector(REALSXP, px + py));
+  stat   = REAL(sexp_stat);
+  center = REAL(sexp_center);
+
+  leafStatCenter(n, x, y, px, py, center);
+  rowX = (double *) R_alloc((size_t) numThreads * (px + py), sizeof(double));
+  leafStatFill(n, ntree, membership, inbag, x, y, px, py, center, offset, stat, rowX, numThreads);
+
+  UNPROTECT(3);
+  return out;
+}
+
+// Unpacks the packed lower triangle of a p x p matrix into a, after
+// removing the weighted means.
+static void leafStatScatter(double *packed, double *sa, double *sb, double w, int p, double *a)
+{
+  int i, j;
+  for (j = 0; j < p; j++) {
+    for (i = j; i < p; i++) {
+      a[i + j * p] = *(packed++) - sa[i] * sb[j] / w;
+    }
+  }
+}
+
+// Cholesky factor of the p x p matrix a in its lower triangle.  Returns
+// zero when a pivot falls below RFCCA_CHOL_TOL of its diagonal entry,
+// the counterpart of the rank check of the QR based estimator.
+static int leafStatChol(int p, double *a)
+{
+  char lower = 'L';
+  int j, info;
+  double *diag = a + p * p;
+
+  for (j = 0; j < p; j++) {
+    diag[j] = a[j + j * p];
+    if (!(diag[j] > 0.0)) return 0;
+  }
+  F77_CALL(dpotrf)(&lower, &p, a, &p, &info FCONE);
+  if (info != 0) return 0;
+  for (j = 0; j < p; j++) {
+    if (a[j + j * p] * a[j + j * p] < RFCCA_CHOL_TOL * diag[j]) return 0;
+  }
+  return 1;
+}
+
+// Size of the scratch space of one call of leafStatEstimate(), for the
+// summed statistics, the two Cholesky factors with their diagonals, the
+// whitened cross-products and the SVD, whose workspace size is lwork.
+int leafStatWorkSize(int px, int py, int *lwork)
+{
+  char jobu = 'S', jobvt = 'S';
+  int minDim = (px < py) ? px : py;
+  int maxDim = (px < py) ? py : px;
+  int info, query_lwork = -1;
+  double query, dummy = 0.0;
+
+  F77_CALL(dgesvd)(&jobu, &jobvt, &py, &px, &dummy, &py, &dummy, &dummy, &py, &dummy, &minDim, &query, &query_lwork, &info FCONE FCONE);
+  *lwork = (int) query;
+  if (*lwork < 5 * maxDim) *lwork = 5 * maxDim;
+  return leafStatSize(px, py) + (px * px + px) + (py * py + py) + px * py + minDim + py * minDim + minDim * px + *lwork;
+}
+
+/*
+  The sign of a canonical pair is arbitrary.  All final estimators flip
+  the coefficients (a, b) in estimate, after the correlation, so that
+  the X coefficient of largest magnitude, the first one on ties, is
+  positive.  The estimates from the terminal node statistics, from the
+  BOPs and from the R fallback of rank deficient BOPs then agree.
+*/
+void rfccaSignEstimate(double *estimate, int px, int py)
+{
+  int j;
+  double big = 0.0;
+
+  for (j = 0; j < px; j++) {
+    if (fabs(estimate[1 + j]) > fabs(big)) big = estimate[1 + j];
+  }
+  if (big < 0.0) {
+    for (j = 1; j < 1 + px + py; j++) estimate[j] = -estimate[j];
+  }
+}
+
+/*
+  CCA from the summed statistics s of an observation:  with Cxx = Lx Lx'
+  and Cyy = Ly Ly', whose Cholesky factors are computed in the scratch
+  space work, the SVD U S V' of Ly^-1 Cyx Lx^-T gives the correlation
+  s1 and the coefficients a = Lx^-T v1 and b = Ly^-T u1, normalized as
+  those of cancor() by a'Cxx a = b'Cyy b = 1, and signed by
+  rfccaSignEstimate().
+*/
+int leafStatEstimate(double *s, int px, int py, double *work, int lwork, double *estimate)
+{
+  char left = 'L', right = 'R', lower = 'L', noTrans = 'N', trans = 'T', nonUnit = 'N';
+  char jobu = 'S', jobvt = 'S';
+  double alpha = 1.0;
+  int minDim = (px < py) ? px : py;
+  int i, j, info, incr = 1;
+  double w = s[0];
+  double *sx  = s + 1;
+  double *sy  = sx + px;
+  double *sxx = sy + py;
+  double *syy = sxx + (px * (px + 1)) / 2;
+  double *sxy = syy + (py * (py + 1)) / 2;
+  double *Lx  = work;
+  double *Ly  = Lx + px * px + px;
+  double *C   = Ly + py * py + py;
+  double *S   = C + px * py;
+  double *U   = S + minDim;
+  double *VT  = U + py * minDim;
+  double *svdWork = VT + minDim * px;
+
+  if (w <= 0.0) return RFCCA_EST_EMPTY;
+  leafStatScatter(sxx, sx, sx, w, px, Lx);
+  leafStatScatter(syy, sy, sy, w, py, Ly);
+  if (!leafStatChol(px, Lx) || !leafStatChol(py, Ly)) return RFCCA_EST_RANK;
+  // C = Cyx = (Sxy - sx sy' / w)'.
+  for (j = 0; j < py; j++) {
+    for (i = 0; i < px; i++) {
+      C[j + i * py] = sxy[i + j * px] - sx[i] * sy[j] / w;
+    }
+  }
+  F77_CALL(dtrsm)(&left, &lower, &noTrans, &nonUnit, &py, &px, &alpha, Ly, &py, C, &py FCONE FCONE FCONE FCONE);
+  F77_CALL(dtrsm)(&right, &lower, &trans, &nonUnit, &py, &px, &alpha, Lx, &px, C, &py FCONE FCONE FCONE FCONE);
+  F77_CALL(dgesvd)(&jobu, &jobvt, &py, &px, C, &py, S, U, &py, VT, &minDim, svdWork, &lwork, &info FCONE FCONE);
+  if (info != 0) return RFCCA_EST_RANK;
+  estimate[0] = S[0];
+  for (j = 0; j < px; j++) estimate[1 + j] = VT[j * minDim];
+  for (j = 0; j < py; j++) estimate[1 + px + j] = U[j];
+  F77_CALL(dtrsv)(&lower, &trans, &nonUnit, &px, Lx, &px, estimate + 1, &incr FCONE FCONE FCONE);
+  F77_CALL(dtrsv)(&lower, &trans, &nonUnit, &py, Ly, &py, estimate + 1 + px, &incr FCONE FCONE FCONE);
+  rfccaSignEstimate(estimate, px, py);
+  return RFCCA_EST_OK;
+}
+
+// Estimates of the m observations of the m x ntree membership test from
+// the statistics of their terminal nodes, skipping the trees in which
+// they are inbag when inbag is given.  Each thread sums the statistics
+// in its own workSize doubles of work.
+static void leafStatEstimateRows(double *stat, int *offset, int ntree, int *test, int *inbag, int m,
+                                 int px, int py, double *work, int workSize, int lwork, int numThreads,
+                                 double *estimate, int *status)
+{
+  int statSize = leafStatSize(px, py);
+  int obs;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(numThreads) schedule(static)
+#endif
+  for (obs = 0; obs < m; obs++) {
+    int thread = 0, tree, node, k;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+#endif
+    double *sum = work + (size_t) thread * workSize;
+    double *column = estimate + (size_t) obs * (1 + px + py);
+    double *leaf;
+    for (k = 0; k < 1 + px + py; k++) {
+      column[k] = NA_REAL;
+    }
+    for (k = 0; k < statSize; k++) {
+      sum[k] = 0.0;
+    }
+    for (tree = 0; tree < ntree; tree++) {
+      if ((inbag != NULL) && (inbag[obs + (size_t) tree * m] > 0)) continue;
+      node = test[obs + (size_t) tree * m];
+      if ((node > 0) && (node <= offset[tree + 1] - offset[tree])) {
+        leaf = stat + (size_t) (offset[tree] + node - 1) * statSize;
+        for (k = 0; k < statSize; k++) {
+          sum[k] += leaf[k];
+        }
+      }
+    }
+    status[obs] = leafStatEstimate(sum, px, py, sum + statSize, lwork, column);
+  }
+}
+
+/*
+  sexp_stat       - the statistics of the terminal nodes.
+  sexp_offset     - offsets of the trees in sexp_stat.
+  sexp_test       - m x ntree terminal node membership of the observations.
+  sexp_inbag      - with the training membership as sexp_test, the n x ntree
+                    inbag counts, so that only the trees in which an
+                    observation is out-of-bag count, or NULL.
+  sexp_px         - number of X variables.
+  sexp_py         - number of Y variables.
+  sexp_numThreads - number of threads (negative for all available).
+
+  Returns a list with estimate and status as rfccaEstimate() does.
+*/
+SEXP rfccaLeafEstimate(SEXP sexp_stat,
+                       SEXP sexp_offset,
+                       SEXP sexp_test,
+                       SEXP sexp_inbag,
+                       SEXP sexp_px,
+                       SEXP sexp_py,
+                       SEXP sexp_numThreads)
+{
+  double *stat       = REAL(sexp_stat);
+  int    *offset     = INTEGER(sexp_offset);
+  int     ntree      = LENGTH(sexp_offset) - 1;
+  int    *test       = INTEGER(sexp_test);
+  int    *inbag      = (sexp_inbag == R_NilValue) ? NULL : INTEGER(sexp_inbag);
+  int     m          = LENGTH(sexp_test) / ntree;
+  int     px         = INTEGER(sexp_px)[0];
+  int     py         = INTEGER(sexp_py)[0];
+  int     numThreads = getThreadCount(sexp_numThreads);
+  int     workSize, lwork;
+  double *estimate, *work;
+  int    *status;
+  SEXP    out, names, sexp_estimate;
+
+  workSize = leafStatWorkSize(px, py, &lwork);
+  work = (double *) R_alloc((size_t) numThreads * workSize, sizeof(double));
+
+  PROTECT(out = allocVector(VECSXP, 2));
+  PROTECT(names = allocVector(STRSXP, 2));
+  SET_STRING_ELT(names, 0, mkChar("estimate"));
+  SET_STRING_ELT(names, 1, mkChar("status"));
+  setAttrib(out, R_NamesSymbol, names);
+  SET_VECTOR_ELT(out, 0, sexp_estimate = allocMatrix(REALSXP, 1 + px + py, m));
+  SET_VECTOR_ELT(out, 1, allocVector(INTSXP, m));
+  estimate = REAL(sexp_estimate);
+  status   = INTEGER(VECTOR_ELT(out, 1));
+
+  leafStatEstimateRows(stat, offset, ntree, test, inbag, m, px, py, work, workSize, lwork, numThreads,
+                       estimate, status);
+
+  UNPROTECT(2);
+  return out;
+}
+
+/*
+  OOB canonical correlations of the permutations of global.significance,
+  whose forests are grown together, the trees of permutation p being
+  ntree consecutive trees.  The statistics of the terminal nodes of one
+  permutation at a time are computed and summed over the trees in which
+  each training observation is out-of-bag, so that neither the
+  statistics nor the coefficients of the permutations are returned.
+
+  sexp_membership - n x (ntree P) terminal node membership of the training data.
+  sexp_inbag      - n x (ntree P) inbag counts of the training data.
+  sexp_x, sexp_y  - the n x px and n x py training data.
+  sexp_ntree      - number of trees per permutation.
+  sexp_numThreads - number of threads (negative for all available).
+
+  Returns a list with the n x P canonical correlations in estimate and
+  their status, as rfccaEstimate() gives it, in status.
+*/
+SEXP rfccaPermEstimate(SEXP sexp_membership,
+                       SEXP sexp_inbag,
+                       SEXP sexp_x,
+                       SEXP sexp_y,
+                       SEXP sexp_ntree,
+                       SEXP sexp_px,
+                       SEXP sexp_py,
+                       SEXP sexp_numThreads)
+{
+  int    *membership = INTEGER(sexp_membership);
+  int    *inbag      = INTEGER(sexp_inbag);
+  double *x          = REAL(sexp_x);
+  double *y          = REAL(sexp_y);
+  int     ntree      = INTEGER(sexp_ntree)[0];
+  int     px         = INTEGER(sexp_px)[0];
+  int     py         = INTEGER(sexp_py)[0];
+  int     n          = LENGTH(sexp_x) / px;
+  int     nperm      = LENGTH(sexp_membership) / ((size_t) n * ntree);
+  int     numThreads = getThreadCount(sexp_numThreads);
+  int     statSize   = leafStatSize(px, py);
+  int     workSize, lwork, nodeCount, maxCount, perm, i;
+  int    *offset, *status, *permStatus;
+  double *center, *rowX, *work, *stat, *column, *estimate;
+  size_t  block;
+  SEXP    out, names, sexp_estimate, sexp_status;
+
+  block = (size_t) n * ntree;
+  offset = (int *) R_alloc((size_t) nperm * (ntree + 1), sizeof(int));
+  maxCount = 0;
+  for (perm = 0; perm < nperm; perm++) {
+    nodeCount = leafStatOffset(n, ntree, membership + perm * block, offset + (size_t) perm * (ntree + 1));
+    if (nodeCount > maxCount) maxCount = nodeCount;
+  }
+  center = (double *) R_alloc(px + py, sizeof(double));
+  rowX   = (double *) R_alloc((size_t) numThreads * (px + py), sizeof(double));
+  workSize = leafStatWorkSize(px, py, &lwork);
+  work   = (double *) R_alloc((size_t) numThreads * workSize, sizeof(double));
+  stat   = (double *) R_alloc((size_t) statSize * maxCount, sizeof(double));
+  column = (double *) R_alloc((size_t) n * (1 + px + py), sizeof(double));
+  leafStatCenter(n, x, y, px, py, center);
+
+  PROTECT(out = allocVector(VECSXP, 2));
+  PROTECT(names = allocVector(STRSXP, 2));
+  SET_STRING_ELT(names, 0, mkChar("estimate"));
+  SET_STRING_ELT(names, 1, mkChar("status"));
+  setAttrib(out, R_NamesSymbol, names);
+  SET_VECTOR_ELT(out, 0, sexp_estimate = allocMatrix(REALSXP, n, nperm));
+  SET_VECTOR_ELT(out, 1, sexp_status = allocMatrix(INTSXP, n, nperm));
+  estimate = REAL(sexp_estimate);
+  status   = INTEGER(sexp_status);
+
+  for (perm = 0; perm < nperm; perm++) {
+    int *permOffset = offset + (size_t) perm * (ntree + 1);
+    permStatus = status + (size_t) perm * n;
+    leafStatFill(n, ntree, membership + perm * block, inbag + perm * block, x, y, px, py, center,
+                 permOffset, stat, rowX, numThreads);
+    leafStatEstimateRows(stat, permOffset, ntree, membership + perm * block, inbag + perm * block, n,
+                         px, py, work, workSize, lwork, numThreads, column, permStatus);
+    for (i = 0; i < n; i++) {
+      estimate[i + (size_t) perm * n] = column[(size_t) i * (1 + px + py)];
+    }
+  }
+
+  UNPROTECT(2);
+  return out;
+}
@@ -0,0 +1,18 @@
+#ifndef RFCCA_LEAF_STAT_H
+#define RFCCA_LEAF_STAT_H
+
+/*
+  Terminal node sufficient statistics shared by the prediction routines,
+  see rfccaLeafStat.c for their layout.
+*/
+
+#define RFCCA_EST_OK    0
+#define RFCCA_EST_EMPTY 1
+#define RFCCA_EST_RANK  2
+
+int leafStatSize(int px, int py);
+int leafStatWorkSize(int px, int py, int *lwork);
+int leafStatEstimate(double *s, int px, int py, double *work, int lwork, double *estimate);
+void rfccaSignEstimate(double *estimate, int px, int py);
+
+#endif
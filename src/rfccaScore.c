@@ -0,0 +1,742 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <Rdefines.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "rfccaLeafStat.h"
+
+/*
+  Prepared Models for Scoring
+
+  A prepared model holds its own copy of the trees of the forest and of
+  the terminal node statistics, so that the terminal nodes of a few new
+  observations can be found and their statistics summed directly, with
+  no call to the rfsrc prediction machinery and no BOPs.
+
+  The trees are decoded from the nativeArray and nativeFactorArray
+  records, which list the nodes of each tree in pre-order.  A node with
+  a positive parmID splits on that Z variable, with the left daughter
+  following it in the record and the right daughter following the left
+  subtree.  The nodes are sent left as in the rfsrc prediction, when
+  the value is at most contPT for continuous splits, and when the bit of
+  the factor level is set in the mwcpSZ words of the split for factor
+  splits.  A node with parmID zero is terminal, and its nodeID is the
+  column of the terminal node statistics within its tree.
+*/
+
+#define RFCCA_UINT_BITS (sizeof(unsigned int) * 8)
+
+typedef struct rfccaModel RFCCAModel;
+struct rfccaModel {
+  int           ntree;
+  int           nodeCount;
+  int           px, py, pz;
+  int          *root;      // first record of each tree
+  int          *parmID;
+  int          *nodeID;
+  int          *right;     // record of the right daughter of a split
+  double       *contPT;
+  int          *mwcpSZ;
+  int          *mwcpStart; // first factor word of a split
+  unsigned int *mwcpPT;
+  int           statSize;
+  int          *offset;
+  double       *stat;
+  char         *map;       // model file the arrays point into, or NULL
+  size_t        mapSize;
+  char          mapped;    // map is memory mapped rather than read
+};
+
+static void freeModel(RFCCAModel *model)
+{
+  if (model == NULL) return;
+  if (model -> map != NULL) {
+#ifndef _WIN32
+    if (model -> mapped) {
+      munmap(model -> map, model -> mapSize);
+    }
+    else {
+      free(model -> map);
+    }
+#else
+    free(model -> map);
+#endif
+    free(model);
+    return;
+  }
+  free(model -> root);
+  free(model -> parmID);
+  free(model -> nodeID);
+  free(model -> right);
+  free(model -> contPT);
+  free(model -> mwcpSZ);
+  free(model -> mwcpStart);
+  free(model -> mwcpPT);
+  free(model -> offset);
+  free(model -> stat);
+  free(model);
+}
+
+static void modelFinalizer(SEXP ptr)
+{
+  freeModel((RFCCAModel *) R_ExternalPtrAddr(ptr));
+  R_ClearExternalPtr(ptr);
+}
+
+// Sets the right daughters of the subtree at record k and returns the
+// record following the subtree, or -1 when the subtree runs past the
+// last record.
+static int linkSubtree(RFCCAModel *model, int k)
+{
+  int next;
+  if (k >= model -> nodeCount) {
+    return -1;
+  }
+  next = k + 1;
+  model -> right[k] = -1;
+  if (model -> parmID[k] > 0) {
+    next = linkSubtree(model, next);
+    if (next < 0) return -1;
+    model -> right[k] = next;
+    next = linkSubtree(model, next);
+  }
+  return next;
+}
+
+static char splitLeft(RFCCAModel *model, int k, double value)
+{
+  unsigned int level, word;
+  if (model -> mwcpSZ[k] > 0) {
+    level = (unsigned int) value;
+    if (level < 1) return FALSE;
+    word = (level - 1) / RFCCA_UINT_BITS;
+    if (word >= (unsigned int) model -> mwcpSZ[k]) return FALSE;
+    return (model -> mwcpPT[model -> mwcpStart[k] + word] >> ((level - 1) % RFCCA_UINT_BITS)) & 1U;
+  }
+  return (model -> contPT[k] - value) >= 0.0;
+}
+
+// Record of the terminal node of tree reached by the observation whose
+// value of the Z variable v is z[(v - 1) * stride].
+static size_t findLeaf(RFCCAModel *model, int tree, double *z, size_t stride)
+{
+  size_t k = model -> root[tree];
+  while (model -> parmID[k] > 0) {
+    if (splitLeft(model, k, z[(size_t) (model -> parmID[k] - 1) * stride])) {
+      k = k + 1;
+    }
+    else {
+      k = model -> right[k];
+    }
+  }
+  return k;
+}
+
+/*
+  sexp_treeID ... sexp_mwcpPT - the nativeArray and nativeFactorArray
+                                columns of the forest.
+  sexp_ntree                  - number of trees.
+  sexp_stat, sexp_offset      - terminal node statistics of the forest.
+  sexp_px, sexp_py, sexp_pz   - number of X, Y and Z variables.
+
+  Returns an external pointer to the prepared model.
+*/
+SEXP rfccaPrepare(SEXP sexp_treeID,
+                  SEXP sexp_nodeID,
+                  SEXP sexp_parmID,
+                  SEXP sexp_contPT,
+                  SEXP sexp_mwcpSZ,
+                  SEXP sexp_mwcpPT,
+                  SEXP sexp_ntree,
+                  SEXP sexp_stat,
+                  SEXP sexp_offset,
+                  SEXP sexp_px,
+                  SEXP sexp_py,
+                  SEXP sexp_pz)
+{
+  int nodeCount = LENGTH(sexp_parmID);
+  int ntree     = INTEGER(sexp_ntree)[0];
+  int *treeID   = INTEGER(sexp_treeID);
+  int factorCount = LENGTH(sexp_mwcpPT);
+  int k, tree, words, next;
+  RFCCAModel *model;
+  SEXP ptr;
+
+  model = (RFCCAModel *) calloc(1, sizeof(RFCCAModel));
+  if (model == NULL) {
+    error("Cannot allocate the prepared model.");
+  }
+  model -> ntree     = ntree;
+  model -> nodeCount = nodeCount;
+  model -> px        = INTEGER(sexp_px)[0];
+  model -> py        = INTEGER(sexp_py)[0];
+  model -> pz        = INTEGER(sexp_pz)[0];
+  model -> statSize  = leafStatSize(model -> px, model -> py);
+  model -> root      = (int *) malloc(sizeof(int) * (ntree + 1));
+  model -> parmID    = (int *) malloc(sizeof(int) * (nodeCount + 1));
+  model -> nodeID    = (int *) malloc(sizeof(int) * (nodeCount + 1));
+  model -> right     = (int *) malloc(sizeof(int) * (nodeCount + 1));
+  model -> contPT    = (double *) malloc(sizeof(double) * (nodeCount + 1));
+  model -> mwcpSZ    = (int *) malloc(sizeof(int) * (nodeCount + 1));
+  model -> mwcpStart = (int *) malloc(sizeof(int) * (nodeCount + 1));
+  model -> mwcpPT    = (unsigned int *) malloc(sizeof(unsigned int) * (factorCount + 1));
+  model -> offset    = (int *) malloc(sizeof(int) * (ntree + 1));
+  model -> stat      = (double *) malloc(sizeof(double) * ((size_t) LENGTH(sexp_stat) + 1));
+  if ((model -> root == NULL) || (model -> parmID == NULL) || (model -> nodeID == NULL) ||
+      (model -> right == NULL) || (model -> contPT == NULL) || (model -> mwcpSZ == NULL) ||
+      (model -> mwcpStart == NULL) || (model -> mwcpPT == NULL) || (model -> offset == NULL) ||
+      (model -> stat == NULL)) {
+    freeModel(model);
+    error("Cannot allocate the prepared model.");
+  }
+
+  memcpy(model -> parmID, INTEGER(sexp_parmID), sizeof(int) * nodeCount);
+  memcpy(model -> nodeID, INTEGER(sexp_nodeID), sizeof(int) * nodeCount);
+  memcpy(model -> contPT, REAL(sexp_contPT), sizeof(double) * nodeCount);
+  memcpy(model -> mwcpSZ, INTEGER(sexp_mwcpSZ), sizeof(int) * nodeCount);
+  for (k = 0; k < factorCount; k++) {
+    model -> mwcpPT[k] = (unsigned int) INTEGER(sexp_mwcpPT)[k];
+  }
+  memcpy(model -> offset, INTEGER(sexp_offset), sizeof(int) * (ntree + 1));
+  memcpy(model -> stat, REAL(sexp_stat), sizeof(double) * LENGTH(sexp_stat));
+
+  // The factor words are stored in node order across the whole forest.
+  words = 0;
+  for (k = 0; k < nodeCount; k++) {
+    model -> mwcpStart[k] = words;
+    words += (model -> parmID[k] > 0) ? model -> mwcpSZ[k] : 0;
+  }
+  next = 0;
+  for (tree = 0; tree < ntree; tree++) {
+    model -> root[tree] = next;
+    if ((next < nodeCount) && (treeID[next] == tree + 1)) {
+      next = linkSubtree(model, next);
+    }
+    else {
+      next = -1;
+    }
+    if (next < 0) break;
+  }
+  model -> root[ntree] = next;
+  if ((next != nodeCount) || (words > factorCount) || (model -> offset[ntree] * model -> statSize != LENGTH(sexp_stat))) {
+    freeModel(model);
+    error("Invalid forest record.");
+  }
+
+  PROTECT(ptr = R_MakeExternalPtr(model, R_NilValue, R_NilValue));
+  R_RegisterCFinalizerEx(ptr, modelFinalizer, TRUE);
+  UNPROTECT(1);
+  return ptr;
+}
+
+/*
+  sexp_model      - a prepared model.
+  sexp_z          - the m x pz Z values of the observations, with factors
+                    coded by their levels in the training data.
+  sexp_numThreads - number of threads (negative for all available).
+
+  Returns a list with estimate and status as rfccaLeafEstimate() does,
+  and the m x ntree terminal node membership of the observations.
+*/
+SEXP rfccaScore(SEXP sexp_model,
+                SEXP sexp_z,
+                SEXP sexp_numThreads)
+{
+  RFCCAModel *model = (RFCCAModel *) R_ExternalPtrAddr(sexp_model);
+  double *z;
+  int m, px, py, statSize, workSize, lwork, obs;
+  int numThreads = 1;
+  double *estimate, *work;
+  int *status, *membership;
+  SEXP out, names, sexp_estimate, sexp_membership;
+
+  if (model == NULL) {
+    error("The prepared model is no longer valid.  Prepare it again.");
+  }
+  z  = REAL(sexp_z);
+  m  = LENGTH(sexp_z) / model -> pz;
+  px = model -> px;
+  py = model -> py;
+  statSize = model -> statSize;
+#ifdef _OPENMP
+  numThreads = INTEGER(sexp_numThreads)[0];
+  if (numThreads < 0) {
+    numThreads = omp_get_max_threads();
+  }
+  else {
+    numThreads = (numThreads < omp_get_max_threads()) ? (numThreads) : (omp_get_max_threads());
+  }
+  if (numThreads < 1) numThreads = 1;
+  // A single observation is not worth the start of a thread team.
+  if (m < numThreads) numThreads = (m > 0) ? m : 1;
+#endif
+
+  workSize = leafStatWorkSize(px, py, &lwork);
+  work = (double *) R_alloc((size_t) numThreads * workSize, sizeof(double));
+
+  PROTECT(out = allocVector(VECSXP, 3));
+  PROTECT(names = allocVector(STRSXP, 3));
+  SET_STRING_ELT(names, 0, mkChar("estimate"));
+  SET_STRING_ELT(names, 1, mkChar("status"));
+  SET_STRING_ELT(names, 2, mkChar("membership"));
+  setAttrib(out, R_NamesSymbol, names);
+  SET_VECTOR_ELT(out, 0, sexp_estimate = allocMatrix(REALSXP, 1 + px + py, m));
+  SET_VECTOR_ELT(out, 1, allocVector(INTSXP, m));
+  SET_VECTOR_ELT(out, 2, sexp_membership = allocMatrix(INTSXP, m, model -> ntree));
+  estimate   = REAL(sexp_estimate);
+  status     = INTEGER(VECTOR_ELT(out, 1));
+  membership = INTEGER(sexp_membership);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(numThreads) schedule(static)
+#endif
+  for (obs = 0; obs < m; obs++) {
+    int thread = 0, tree, node, j;
+    size_t k;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+#endif
+    double *sum = work + (size_t) thread * workSize;
+    double *column = estimate + (size_t) obs * (1 + px + py);
+    double *leaf;
+    for (j = 0; j < 1 + px + py; j++) {
+      column[j] = NA_REAL;
+    }
+    for (j = 0; j < statSize; j++) {
+      sum[j] = 0.0;
+    }
+    for (tree = 0; tree < model -> ntree; tree++) {
+      k = findLeaf(model, tree, z + obs, m);
+      node = model -> nodeID[k];
+      membership[obs + (size_t) tree * m] = node;
+      if ((node > 0) && (node <= model -> offset[tree + 1] - model -> offset[tree])) {
+        leaf = model -> stat + (size_t) (model -> offset[tree] + node - 1) * statSize;
+        for (j = 0; j < statSize; j++) {
+          sum[j] += leaf[j];
+        }
+      }
+    }
+    status[obs] = leafStatEstimate(sum, px, py, sum + statSize, lwork, column);
+  }
+
+  UNPROTECT(2);
+  return out;
+}
+
+/*
+  Variable importance of the Z variables for the CCA forest itself.  The
+  OOB canonical correlation of each training observation is found from
+  the statistics of the terminal nodes of its OOB trees, once with the
+  training Z and once for every Z variable with the value of that
+  variable taken from another training observation, as given by a
+  permutation of the rows.  The Z variables are processed in parallel.
+
+  sexp_model      - a prepared model of the forest.
+  sexp_z          - the n x pz training Z, with factors coded by level.
+  sexp_inbag      - n x ntree inbag counts of the training data.
+  sexp_perm       - n x pz permutations (1-based rows) of the Z variables.
+  sexp_numThreads - number of threads (negative for all available).
+
+  Returns the n x (1 + pz) matrix of the OOB canonical correlations,
+  unpermuted in the first column and with Z variable v permuted in
+  column 1 + v, NA where the correlation cannot be estimated.
+*/
+SEXP rfccaVimp(SEXP sexp_model,
+               SEXP sexp_z,
+               SEXP sexp_inbag,
+               SEXP sexp_perm,
+               SEXP sexp_numThreads)
+{
+  RFCCAModel *model = (RFCCAModel *) R_ExternalPtrAddr(sexp_model);
+  double *z;
+  int *inbag, *perm;
+  int n, px, py, pz, statSize, workSize, lwork, v;
+  int numThreads = 1;
+  double *cor, *work;
+  SEXP out;
+
+  if (model == NULL) {
+    error("The prepared model is no longer valid.  Prepare it again.");
+  }
+  z     = REAL(sexp_z);
+  inbag = INTEGER(sexp_inbag);
+  perm  = INTEGER(sexp_perm);
+  px = model -> px;
+  py = model -> py;
+  pz = model -> pz;
+  n  = LENGTH(sexp_z) / pz;
+  statSize = model -> statSize;
+#ifdef _OPENMP
+  numThreads = INTEGER(sexp_numThreads)[0];
+  if (numThreads < 0) {
+    numThreads = omp_get_max_threads();
+  }
+  else {
+    numThreads = (numThreads < omp_get_max_threads()) ? (numThreads) : (omp_get_max_threads());
+  }
+  if (numThreads < 1) numThreads = 1;
+  if (pz + 1 < numThreads) numThreads = pz + 1;
+#endif
+
+  // Each thread holds the sums, the estimation work space, the estimate
+  // and the Z values of one observation.
+  workSize = leafStatWorkSize(px, py, &lwork) + (1 + px + py) + pz;
+  work = (double *) R_alloc((size_t) numThreads * workSize, sizeof(double));
+
+  PROTECT(out = allocMatrix(REALSXP, n, 1 + pz));
+  cor = REAL(out);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(numThreads) schedule(dynamic)
+#endif
+  for (v = 0; v <= pz; v++) {
+    int thread = 0, obs, tree, node, j;
+    size_t k;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+#endif
+    double *sum = work + (size_t) thread * workSize;
+    double *estimate = sum + workSize - (1 + px + py) - pz;
+    double *row = estimate + (1 + px + py);
+    double *leaf;
+    for (obs = 0; obs < n; obs++) {
+      for (j = 0; j < pz; j++) {
+        row[j] = z[obs + (size_t) j * n];
+      }
+      if (v > 0) {
+        row[v - 1] = z[(perm[obs + (size_t) (v - 1) * n] - 1) + (size_t) (v - 1) * n];
+      }
+      for (j = 0; j < statSize; j++) {
+        sum[j] = 0.0;
+      }
+      for (tree = 0; tree < model -> ntree; tree++) {
+        if (inbag[obs + (size_t) tree * n] > 0) continue;
+        k = findLeaf(model, tree, row, 1);
+        node = model -> nodeID[k];
+        if ((node > 0) && (node <= model -> offset[tree + 1] - model -> offset[tree])) {
+          leaf = model -> stat + (size_t) (model -> offset[tree] + node - 1) * statSize;
+          for (j = 0; j < statSize; j++) {
+            sum[j] += leaf[j];
+          }
+        }
+      }
+      if (leafStatEstimate(sum, px, py, sum + statSize, lwork, estimate) == RFCCA_EST_OK) {
+        cor[obs + (size_t) v * n] = estimate[0];
+      }
+      else {
+        cor[obs + (size_t) v * n] = NA_REAL;
+      }
+    }
+  }
+
+  UNPROTECT(1);
+  return out;
+}
+
+/*
+  Model Files
+
+  A prepared model is written as a flat binary file that is used in
+  place: the model arrays point into the memory mapped file, so scoring
+  processes share one page cached copy of it and start without decoding
+  the forest.  Where mmap() is not available the file is read into one
+  block instead.
+
+  The file holds the header below, followed by the arrays of the model
+  in the order of modelLayout(), each starting on a multiple of eight
+  bytes, and by a metadata block that is opaque to the native code (the
+  R code stores the variable names and factor levels there).  The
+  arrays are in the byte order of the machine that wrote the file,
+  which is checked on reading through byteOrder.  Files of another
+  version are refused.
+*/
+
+#define RFCCA_MODEL_MAGIC   "RFCCAMOD"
+#define RFCCA_MODEL_VERSION 1
+#define RFCCA_MODEL_ORDER   0x01020304U
+#define RFCCA_MODEL_ARRAYS  11
+
+typedef struct rfccaModelHeader RFCCAModelHeader;
+struct rfccaModelHeader {
+  char     magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  int32_t  ntree;
+  int32_t  nodeCount;
+  int32_t  px, py, pz;
+  int32_t  statSize;
+  int32_t  factorCount;
+  int32_t  reserved;
+  int64_t  statCount;
+  int64_t  metaOffset;
+  int64_t  metaSize;
+};
+
+static size_t alignModel(size_t size)
+{
+  return (size + 7) & ~((size_t) 7);
+}
+
+// Byte offsets and sizes of root, parmID, nodeID, right, mwcpSZ,
+// mwcpStart, offset, contPT, stat, mwcpPT and the metadata, in that
+// order.  Returns the size of the file.
+static size_t modelLayout(RFCCAModelHeader *header, size_t *start, size_t *size)
+{
+  size_t nodes = (size_t) header -> nodeCount;
+  size_t trees = (size_t) header -> ntree + 1;
+  size_t next;
+  int k;
+  size[0]  = sizeof(int) * trees;
+  size[1]  = sizeof(int) * nodes;
+  size[2]  = sizeof(int) * nodes;
+  size[3]  = sizeof(int) * nodes;
+  size[4]  = sizeof(int) * nodes;
+  size[5]  = sizeof(int) * nodes;
+  size[6]  = sizeof(int) * trees;
+  size[7]  = sizeof(double) * nodes;
+  size[8]  = sizeof(double) * (size_t) header -> statCount;
+  size[9]  = sizeof(unsigned int) * (size_t) header -> factorCount;
+  size[10] = (size_t) header -> metaSize;
+  next = alignModel(sizeof(RFCCAModelHeader));
+  for (k = 0; k < RFCCA_MODEL_ARRAYS; k++) {
+    start[k] = next;
+    next = alignModel(next + size[k]);
+  }
+  return next;
+}
+
+static void modelArrays(RFCCAModel *model, void **array)
+{
+  array[0] = model -> root;
+  array[1] = model -> parmID;
+  array[2] = model -> nodeID;
+  array[3] = model -> right;
+  array[4] = model -> mwcpSZ;
+  array[5] = model -> mwcpStart;
+  array[6] = model -> offset;
+  array[7] = model -> contPT;
+  array[8] = model -> stat;
+  array[9] = model -> mwcpPT;
+}
+
+/*
+  sexp_model - a prepared model.
+  sexp_file  - the path of the file.
+  sexp_meta  - raw vector stored with the model.
+
+  Writes the model file and returns NULL.
+*/
+SEXP rfccaModelWrite(SEXP sexp_model,
+                     SEXP sexp_file,
+                     SEXP sexp_meta)
+{
+  RFCCAModel *model = (RFCCAModel *) R_ExternalPtrAddr(sexp_model);
+  RFCCAModelHeader header;
+  size_t start[RFCCA_MODEL_ARRAYS], size[RFCCA_MODEL_ARRAYS], fileSize, written, pad;
+  void *array[RFCCA_MODEL_ARRAYS];
+  static const char zero[8] = {0};
+  FILE *file;
+  int k, ok;
+
+  if (model == NULL) {
+    error("The prepared model is no longer valid.  Prepare it again.");
+  }
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, RFCCA_MODEL_MAGIC, 8);
+  header.version     = RFCCA_MODEL_VERSION;
+  header.byteOrder   = RFCCA_MODEL_ORDER;
+  header.ntree       = model -> ntree;
+  header.nodeCount   = model -> nodeCount;
+  header.px          = model -> px;
+  header.py          = model -> py;
+  header.pz          = model -> pz;
+  header.statSize    = model -> statSize;
+  header.factorCount = 0;
+  for (k = 0; k < model -> nodeCount; k++) {
+    if (model -> parmID[k] > 0) header.factorCount += model -> mwcpSZ[k];
+  }
+  header.statCount   = (int64_t) model -> offset[model -> ntree] * model -> statSize;
+  header.metaSize    = LENGTH(sexp_meta);
+  fileSize = modelLayout(&header, start, size);
+  header.metaOffset  = (int64_t) start[RFCCA_MODEL_ARRAYS - 1];
+  modelArrays(model, array);
+  array[RFCCA_MODEL_ARRAYS - 1] = RAW(sexp_meta);
+
+  file = fopen(CHAR(STRING_ELT(sexp_file, 0)), "wb");
+  if (file == NULL) {
+    error("Cannot open the model file for writing.");
+  }
+  ok = (fwrite(&header, sizeof(header), 1, file) == 1);
+  written = sizeof(header);
+  for (k = 0; ok && (k < RFCCA_MODEL_ARRAYS); k++) {
+    pad = start[k] - written;
+    ok = (pad == 0) || (fwrite(zero, 1, pad, file) == pad);
+    ok = ok && ((size[k] == 0) || (fwrite(array[k], 1, size[k], file) == size[k]));
+    written = start[k] + size[k];
+  }
+  pad = fileSize - written;
+  ok = ok && ((pad == 0) || (fwrite(zero, 1, pad, file) == pad));
+  ok = (fclose(file) == 0) && ok;
+  if (!ok) {
+    error("Cannot write the model file.");
+  }
+  return R_NilValue;
+}
+
+// Points the arrays of model into its file and checks that the trees
+// stay within the file, returning zero for a damaged file.
+static int attachModel(RFCCAModel *model, RFCCAModelHeader *header, size_t *start)
+{
+  char *map = model -> map;
+  int k;
+  size_t words = 0;
+  model -> ntree     = header -> ntree;
+  model -> nodeCount = header -> nodeCount;
+  model -> px        = header -> px;
+  model -> py        = header -> py;
+  model -> pz        = header -> pz;
+  model -> statSize  = header -> statSize;
+  model -> root      = (int *) (map + start[0]);
+  model -> parmID    = (int *) (map + start[1]);
+  model -> nodeID    = (int *) (map + start[2]);
+  model -> right     = (int *) (map + start[3]);
+  model -> mwcpSZ    = (int *) (map + start[4]);
+  model -> mwcpStart = (int *) (map + start[5]);
+  model -> offset    = (int *) (map + start[6]);
+  model -> contPT    = (double *) (map + start[7]);
+  model -> stat      = (double *) (map + start[8]);
+  model -> mwcpPT    = (unsigned int *) (map + start[9]);
+  if ((model -> statSize != leafStatSize(model -> px, model -> py)) ||
+      (model -> offset[0] != 0) ||
+      ((int64_t) model -> offset[model -> ntree] * model -> statSize != header -> statCount) ||
+      (model -> root[model -> ntree] != model -> nodeCount)) {
+    return FALSE;
+  }
+  for (k = 0; k < model -> ntree; k++) {
+    if ((model -> root[k] < 0) || (model -> root[k] >= model -> nodeCount) ||
+        (model -> offset[k + 1] < model -> offset[k])) {
+      return FALSE;
+    }
+  }
+  for (k = 0; k < model -> nodeCount; k++) {
+    if (model -> parmID[k] > 0) {
+      if ((model -> parmID[k] > model -> pz) ||
+          (model -> right[k] <= k) || (model -> right[k] >= model -> nodeCount) ||
+          (k + 1 >= model -> nodeCount) ||
+          (model -> mwcpSZ[k] < 0) || (model -> mwcpStart[k] != (int) words)) {
+        return FALSE;
+      }
+      words += model -> mwcpSZ[k];
+    }
+  }
+  return (words <= (size_t) header -> factorCount);
+}
+
+/*
+  sexp_file - the path of a model file written by rfccaModelWrite().
+
+  Returns a list with the prepared model, whose arrays are those of the
+  file, and the metadata stored with it.
+*/
+SEXP rfccaModelMap(SEXP sexp_file)
+{
+  const char *path = CHAR(STRING_ELT(sexp_file, 0));
+  RFCCAModelHeader header;
+  RFCCAModel *model;
+  size_t start[RFCCA_MODEL_ARRAYS], size[RFCCA_MODEL_ARRAYS], fileSize, length;
+  SEXP out, names, ptr, meta;
+  FILE *file;
+  int ok;
+
+  file = fopen(path, "rb");
+  if (file == NULL) {
+    error("Cannot open the model file.");
+  }
+  ok = (fread(&header, sizeof(header), 1, file) == 1);
+  ok = ok && (fseek(file, 0, SEEK_END) == 0);
+  length = ok ? (size_t) ftell(file) : 0;
+  if (!ok || (memcmp(header.magic, RFCCA_MODEL_MAGIC, 8) != 0)) {
+    fclose(file);
+    error("Not a rfcca model file.");
+  }
+  if (header.byteOrder != RFCCA_MODEL_ORDER) {
+    fclose(file);
+    error("The model file was written on a machine of another byte order.");
+  }
+  if (header.version != RFCCA_MODEL_VERSION) {
+    fclose(file);
+    error("Unsupported version %u of the model file.", header.version);
+  }
+  if ((header.ntree < 1) || (header.nodeCount < 1) || (header.statCount < 0) ||
+      (header.factorCount < 0) || (header.metaSize < 0)) {
+    fclose(file);
+    error("The model file is damaged.");
+  }
+  fileSize = modelLayout(&header, start, size);
+  if ((fileSize > length) || (header.metaOffset != (int64_t) start[RFCCA_MODEL_ARRAYS - 1])) {
+    fclose(file);
+    error("The model file is damaged.");
+  }
+  model = (RFCCAModel *) calloc(1, sizeof(RFCCAModel));
+  if (model == NULL) {
+    fclose(file);
+    error("Cannot allocate the prepared model.");
+  }
+  model -> mapSize = fileSize;
+#ifndef _WIN32
+  fclose(file);
+  {
+    int fd = open(path, O_RDONLY);
+    void *map = (fd < 0) ? MAP_FAILED : mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (fd >= 0) close(fd);
+    ok = (map != MAP_FAILED);
+    if (ok) {
+      model -> map = (char *) map;
+      model -> mapped = TRUE;
+    }
+  }
+#else
+  model -> map = (char *) malloc(fileSize);
+  ok = (model -> map != NULL) && (fseek(file, 0, SEEK_SET) == 0) &&
+    (fread(model -> map, 1, fileSize, file) == fileSize);
+  fclose(file);
+#endif
+  if (!ok) {
+    if (model -> map == NULL) free(model);
+    else freeModel(model);
+    error("Cannot map the model file.");
+  }
+  if (!attachModel(model, &header, start)) {
+    freeModel(model);
+    error("The model file is damaged.");
+  }
+
+  PROTECT(ptr = R_MakeExternalPtr(model, R_NilValue, R_NilValue));
+  R_RegisterCFinalizerEx(ptr, modelFinalizer, TRUE);
+  PROTECT(meta = allocVector(RAWSXP, (R_xlen_t) header.metaSize));
+  if (header.metaSize > 0) {
+    memcpy(RAW(meta), model -> map + start[RFCCA_MODEL_ARRAYS - 1], (size_t) header.metaSize);
+  }
+  PROTECT(out = allocVector(VECSXP, 2));
+  PROTECT(names = allocVector(STRSXP, 2));
+  SET_STRING_ELT(names, 0, mkChar("model"));
+  SET_STRING_ELT(names, 1, mkChar("meta"));
+  setAttrib(out, R_NamesSymbol, names);
+  SET_VECTOR_ELT(out, 0, ptr);
+  SET_VECTOR_ELT(out, 1, meta);
+  UNPROTECT(4);
+  return out;
+}
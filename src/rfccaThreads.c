@@ -0,0 +1,150 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <Rdefines.h>
+
+#include <stdlib.h>
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+#include "rfccaThreads.h"
+
+/*
+  Thread Budget for Multithreaded BLAS
+
+  The trees, BOPs and terminal node estimates are processed in parallel
+  by OpenMP threads, each of which calls LAPACK and BLAS.  When R is
+  linked against a multithreaded BLAS (OpenBLAS, MKL, BLIS or FlexiBLAS)
+  every one of these calls may start threads of its own, which
+  oversubscribes the cores and makes throughput collapse.
+
+  The backend is detected at run time by looking up its thread control
+  entry points among the symbols already loaded into the process, so
+  that nothing is linked against any particular BLAS.  With the
+  reference BLAS, or on platforms without dlsym(), no backend is found
+  and the budget leaves the OpenMP threads alone.
+
+  A region of parallel work asks rfccaThreadBudget() how to share its
+  threads, sets the BLAS threads it returns with rfccaBlasSetThreads(),
+  and restores the previous count afterwards.
+*/
+
+typedef void (*BlasSetInt)(int);
+typedef int  (*BlasGetInt)(void);
+typedef void (*BlasSetLong)(long);
+typedef long (*BlasGetLong)(void);
+
+static int   blasBackend = -1;
+static void *blasSet = NULL;
+static void *blasGet = NULL;
+
+static void *blasSymbol(const char *name)
+{
+#ifndef _WIN32
+  return dlsym(RTLD_DEFAULT, name);
+#else
+  return NULL;
+#endif
+}
+
+int rfccaBlasBackend(void)
+{
+  if (blasBackend < 0) {
+    blasBackend = RFCCA_BLAS_NONE;
+    // FlexiBLAS comes first, since it also exports the entry points of
+    // the backend it wraps.
+    if ((blasSet = blasSymbol("flexiblas_set_num_threads")) && (blasGet = blasSymbol("flexiblas_get_num_threads"))) {
+      blasBackend = RFCCA_BLAS_FLEXI;
+    }
+    else if ((blasSet = blasSymbol("openblas_set_num_threads")) && (blasGet = blasSymbol("openblas_get_num_threads"))) {
+      blasBackend = RFCCA_BLAS_OPENBLAS;
+    }
+    else if ((blasSet = blasSymbol("MKL_Set_Num_Threads")) && (blasGet = blasSymbol("MKL_Get_Max_Threads"))) {
+      blasBackend = RFCCA_BLAS_MKL;
+    }
+    else if ((blasSet = blasSymbol("bli_thread_set_num_threads")) && (blasGet = blasSymbol("bli_thread_get_num_threads"))) {
+      blasBackend = RFCCA_BLAS_BLIS;
+    }
+    else {
+      blasSet = blasGet = NULL;
+    }
+  }
+  return blasBackend;
+}
+
+// Number of BLAS threads, one when no backend is found.
+int rfccaBlasGetThreads(void)
+{
+  switch (rfccaBlasBackend()) {
+  case RFCCA_BLAS_NONE:
+    return 1;
+  case RFCCA_BLAS_BLIS:
+    return (int) ((BlasGetLong) blasGet)();
+  default:
+    return ((BlasGetInt) blasGet)();
+  }
+}
+
+void rfccaBlasSetThreads(int threads)
+{
+  if (threads < 1) return;
+  switch (rfccaBlasBackend()) {
+  case RFCCA_BLAS_NONE:
+    break;
+  case RFCCA_BLAS_BLIS:
+    ((BlasSetLong) blasSet)((long) threads);
+    break;
+  default:
+    ((BlasSetInt) blasSet)(threads);
+    break;
+  }
+}
+
+/*
+  Split of numThreads threads between tasks parallel tasks and the BLAS
+  calls each of them makes.  blasThreads is the number of BLAS threads
+  per task, or RFCCA_BLAS_AUTO to give every thread to the tasks unless
+  there are fewer tasks than threads, in which case the spare threads go
+  to BLAS.  numThreads is reduced to the number of task threads, and the
+  number of BLAS threads is returned.  Without a BLAS backend to control
+  numThreads is left alone and one is returned.
+*/
+
+int rfccaThreadBudget(int *numThreads, int tasks, int blasThreads)
+{
+  int total = *numThreads;
+
+  if ((rfccaBlasBackend() == RFCCA_BLAS_NONE) || (total < 1)) {
+    return 1;
+  }
+  if (blasThreads == RFCCA_BLAS_AUTO) {
+    blasThreads = ((tasks > 0) && (tasks < total)) ? (total / tasks) : 1;
+  }
+  if (blasThreads < 1) blasThreads = 1;
+  if (blasThreads > total) blasThreads = total;
+  *numThreads = total / blasThreads;
+  if ((tasks > 0) && (*numThreads > tasks)) {
+    *numThreads = tasks;
+  }
+  return blasThreads;
+}
+
+/*
+  Name and current number of threads of the BLAS backend, for R.
+*/
+
+SEXP rfccaBlasInfo(void)
+{
+  static const char *backendName[] = {"none", "openblas", "mkl", "blis", "flexiblas"};
+  SEXP out, names;
+
+  PROTECT(out = allocVector(VECSXP, 2));
+  PROTECT(names = allocVector(STRSXP, 2));
+  SET_STRING_ELT(names, 0, mkChar("backend"));
+  SET_STRING_ELT(names, 1, mkChar("threads"));
+  setAttrib(out, R_NamesSymbol, names);
+  SET_VECTOR_ELT(out, 0, mkString(backendName[rfccaBlasBackend()]));
+  SET_VECTOR_ELT(out, 1, ScalarInteger(rfccaBlasGetThreads()));
+  UNPROTECT(2);
+  return out;
+}
@@ -0,0 +1,23 @@
+#ifndef RFCCA_THREADS_H
+#define RFCCA_THREADS_H
+
+/*
+  Thread budget between the OpenMP threads of the package and the
+  threads of a multithreaded BLAS, see rfccaThreads.c.
+*/
+
+#define RFCCA_BLAS_NONE     0
+#define RFCCA_BLAS_OPENBLAS 1
+#define RFCCA_BLAS_MKL      2
+#define RFCCA_BLAS_BLIS     3
+#define RFCCA_BLAS_FLEXI    4
+
+// Budget chosen automatically from the number of trees and threads.
+#define RFCCA_BLAS_AUTO    -1
+
+int  rfccaBlasBackend(void);
+int  rfccaBlasGetThreads(void);
+void rfccaBlasSetThreads(int threads);
+int  rfccaThreadBudget(int *numThreads, int tasks, int blasThreads);
+
+#endif
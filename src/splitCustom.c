@@ -5,6 +5,11 @@
 
 #include <stdlib.h>
 #include <math.h>
+#include <float.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "splitCustom.h"
 
 #include <R_ext/Lapack.h>
@@ -618,6 +623,356 @@ double getCustomSplitStatisticCompetingRisk (unsigned int n,
   return delta;
 }
 
+/*
+  CCA Split Workspace
+
+  Scratch space for the CCA split rule.  One workspace is made per
+  thread before the forest is grown, sized for the largest node a tree
+  can have, so that the split search itself never touches the heap.
+  The LAPACK work array is sized once from workspace queries at the
+  largest node size, which bound the optimal size at any smaller one.
+*/
+
+static void ccaSelectKernels(CCAWorkspace *ws);
+static CCAArenaBlock *ccaArenaBlock(size_t size);
+
+CCAWorkspace *ccaMakeWorkspace(unsigned int size,
+                               unsigned int dimX,
+                               unsigned int dimY,
+                               double       tol)
+{
+    char jobu = 'N', jobvt = 'N';
+    int ldu = 1, ldvt = 1;
+    int nRow = size, px = dimX, py = dimY;
+    int lwork = -1, info = 0;
+    double work_query, dummy = 0.0;
+    unsigned int dim = dimX + dimY;
+    unsigned int minDim = (dimX < dimY) ? dimX : dimY;
+    unsigned int i;
+
+    CCAWorkspace *ws = (CCAWorkspace *) malloc(sizeof(CCAWorkspace));
+    ws -> size = size;
+    ws -> dimX = dimX;
+    ws -> dimY = dimY;
+    ws -> tol  = tol;
+
+    ws -> lwork = 1;
+    F77_CALL(dgeqrf)(&nRow, &px, &dummy, &nRow, &dummy, &work_query, &lwork, &info);
+    if ((int) work_query > ws -> lwork) ws -> lwork = (int) work_query;
+    F77_CALL(dgeqrf)(&nRow, &py, &dummy, &nRow, &dummy, &work_query, &lwork, &info);
+    if ((int) work_query > ws -> lwork) ws -> lwork = (int) work_query;
+    F77_CALL(dorgqr)(&nRow, &px, &px, &dummy, &nRow, &dummy, &work_query, &lwork, &info);
+    if ((int) work_query > ws -> lwork) ws -> lwork = (int) work_query;
+    F77_CALL(dorgqr)(&nRow, &py, &py, &dummy, &nRow, &dummy, &work_query, &lwork, &info);
+    if ((int) work_query > ws -> lwork) ws -> lwork = (int) work_query;
+    F77_CALL(dgesvd)(&jobu, &jobvt, &px, &py, &dummy, &px, &dummy, NULL, &ldu, NULL, &ldvt, &work_query, &lwork, &info FCONE FCONE);
+    ws -> svdWork = (int) work_query;
+    if (ws -> svdWork > ws -> lwork) ws -> lwork = ws -> svdWork;
+
+    ws -> packed    = alloc_dvector(size * dim);
+    ws -> left      = alloc_dvector(size * dim);
+    ws -> right     = alloc_dvector(size * dim);
+    ws -> nodeGram  = alloc_dvector(dim * dim);
+    ws -> leftGram  = alloc_dvector(dim * dim);
+    ws -> sweepWork = alloc_dvector((dim * dim) + ccaCrossProductWorkSize(dimX, dimY));
+    ws -> tauX      = alloc_dvector(dimX);
+    ws -> tauY      = alloc_dvector(dimY);
+    ws -> qMul      = alloc_dvector(dimX * dimY);
+    ws -> S         = alloc_dvector(minDim);
+    ws -> work      = alloc_dvector(ws -> lwork);
+    ws -> start     = alloc_dvector(2 * dim);
+    ws -> cholLeftStart  = ws -> start;
+    ws -> qrLeftStart    = ws -> start + dimX;
+    ws -> cholRightStart = ws -> start + dim;
+    ws -> qrRightStart   = ws -> start + dim + dimX;
+    ccaSeedStart(ws, NULL);
+    ccaSelectKernels(ws);
+    ws -> profiling = 0;
+    for (i = 0; i < CCA_PROF_CNT; i++) {
+        ws -> profile[i] = 0.0;
+    }
+    ws -> arena    = ccaArenaBlock(((size_t) size * CCA_ARENA_ROW) + CCA_ARENA_SLACK);
+    ws -> arenaTop = ws -> arena;
+
+    return ws;
+}
+
+void ccaFreeWorkspace(CCAWorkspace *ws)
+{
+    dealloc_dvector(ws -> packed);
+    dealloc_dvector(ws -> left);
+    dealloc_dvector(ws -> right);
+    dealloc_dvector(ws -> nodeGram);
+    dealloc_dvector(ws -> leftGram);
+    dealloc_dvector(ws -> sweepWork);
+    dealloc_dvector(ws -> tauX);
+    dealloc_dvector(ws -> tauY);
+    dealloc_dvector(ws -> qMul);
+    dealloc_dvector(ws -> S);
+    dealloc_dvector(ws -> work);
+    dealloc_dvector(ws -> start);
+    while (ws -> arena != NULL) {
+        CCAArenaBlock *next = ws -> arena -> next;
+        free(ws -> arena);
+        ws -> arena = next;
+    }
+    free(ws);
+}
+
+/*
+  CCA Split Arena
+
+  The scratch vectors of the split search of a node are drawn from an
+  arena of the workspace of the thread, by bumping the top of its block
+  in use, and are given back all at once when the node, or covariate, is
+  done, by releasing the arena to the mark taken before them.  A vector
+  that does not fit the block moves the arena to the next block, made
+  when first needed and kept for the later nodes.  When a tree is done
+  the arena is reset, merging the blocks into one of their total size,
+  so that the next trees draw their vectors from a single block without
+  any allocation.
+*/
+
+static CCAArenaBlock *ccaArenaBlock(size_t size)
+{
+    CCAArenaBlock *block = (CCAArenaBlock *) malloc(sizeof(CCAArenaBlock) + size);
+    block -> next = NULL;
+    block -> size = size;
+    block -> used = 0;
+    return block;
+}
+
+void *ccaArenaAlloc(CCAWorkspace *ws, size_t bytes)
+{
+    CCAArenaBlock *block = ws -> arenaTop;
+    void *v;
+    // Vectors start on a double.
+    bytes = (bytes + sizeof(double) - 1) & ~(sizeof(double) - 1);
+    while ((block -> used + bytes) > block -> size) {
+        if (block -> next == NULL) {
+            block -> next = ccaArenaBlock((bytes > block -> size) ? bytes : block -> size);
+        }
+        block = block -> next;
+        block -> used = 0;
+    }
+    ws -> arenaTop = block;
+    v = (char *) block -> data + block -> used;
+    block -> used += bytes;
+    return v;
+}
+
+CCAArenaMark ccaArenaSave(CCAWorkspace *ws)
+{
+    CCAArenaMark mark;
+    mark.block = ws -> arenaTop;
+    mark.used  = ws -> arenaTop -> used;
+    return mark;
+}
+
+void ccaArenaRelease(CCAWorkspace *ws, CCAArenaMark mark)
+{
+    ws -> arenaTop = mark.block;
+    mark.block -> used = mark.used;
+}
+
+void ccaArenaReset(CCAWorkspace *ws)
+{
+    CCAArenaBlock *block, *next;
+    size_t size;
+    if (ws -> arena -> next != NULL) {
+        size = 0;
+        for (block = ws -> arena; block != NULL; block = next) {
+            next = block -> next;
+            size += block -> size;
+            free(block);
+        }
+        ws -> arena = ccaArenaBlock(size);
+    }
+    ws -> arena -> used = 0;
+    ws -> arenaTop = ws -> arena;
+}
+
+// Seeds the warm starts of both daughters with the start vectors of
+// length dimX + dimY left by the split of the parent node, or with zeros
+// when seed is NULL.
+void ccaSeedStart(CCAWorkspace *ws, double *seed)
+{
+    unsigned int dim = ws -> dimX + ws -> dimY;
+    unsigned int i;
+
+    for (i = 0; i < dim; i++) {
+        ws -> start[i] = ws -> start[dim + i] = (seed != NULL) ? seed[i] : 0.0;
+    }
+}
+
+// Copies the warm starts of both daughters, 2 * (dimX + dimY) values,
+// out to dest.
+void ccaSaveStart(CCAWorkspace *ws, double *dest)
+{
+    unsigned int i;
+
+    for (i = 0; i < 2 * (ws -> dimX + ws -> dimY); i++) {
+        dest[i] = ws -> start[i];
+    }
+}
+
+// Wall clock of the profile timers, in seconds.
+double ccaProfileClock(void)
+{
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else
+    return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/*
+  Leading Singular Value by Power Iteration
+
+  The split statistic only needs the first singular value of the small
+  matrix coupling the daughter X and Y blocks.  When tol > 0 it is found
+  by power iteration on A'A instead of a full SVD, started from the
+  vector left behind by the previous call on the same daughter, which
+  for consecutive split points is already a good approximation.  The
+  search of each covariate is seeded by ccaSeedStart() with the vector
+  of the daughter the node was in when its parent was split, and from
+  zero at the root, so that a tree does not depend on the trees grown
+  before it in the same workspace.
+
+  The iteration stops once the residual | A'u - s v | of the current
+  pair (u, v) falls below tol * s.  A singular value of A then lies
+  within tol * s of the estimate.  A non-zero info is returned when the
+  iteration does not converge within CCA_POWER_MAXITER steps, and the
+  caller must then use the SVD.  A is not modified.
+
+  A     - column-major m x n matrix.
+  start - vector of length n with the starting vector on entry and the
+          leading right singular vector estimate on exit.
+  u     - scratch vector of length m.
+*/
+
+static double ccaPowerSingularValue(int     m,
+                                    int     n,
+                                    double *A,
+                                    double *start,
+                                    double *u,
+                                    double  tol,
+                                    int    *info)
+{
+    char noTrans = 'N';
+    int incr = 1;
+    double alpha = 1.0, beta = 0.0;
+    double norm, sigma, residual, value;
+    int i, iter;
+
+    norm = 0.0;
+    for (i = 0; i < n; i++) norm += start[i] * start[i];
+    if (norm <= 0.0) {
+        for (i = 0; i < n; i++) start[i] = 1.0;
+        norm = n;
+    }
+    norm = sqrt(norm);
+    for (i = 0; i < n; i++) start[i] /= norm;
+
+    *info = 1;
+    sigma = 0.0;
+    for (iter = 0; iter < CCA_POWER_MAXITER; iter++) {
+        // u = A v / | A v |
+        F77_CALL(dgemv)(&noTrans, &m, &n, &alpha, A, &m, start, &incr, &beta, u, &incr FCONE);
+        sigma = 0.0;
+        for (i = 0; i < m; i++) sigma += u[i] * u[i];
+        sigma = sqrt(sigma);
+        if (sigma <= 0.0) {
+            // The starting vector is in the null space of A.
+            break;
+        }
+        for (i = 0; i < m; i++) u[i] /= sigma;
+
+        // v = A'u, compared with the previous v before it is normalized.
+        residual = 0.0;
+        norm = 0.0;
+        for (i = 0; i < n; i++) {
+            value = F77_CALL(ddot)(&m, A + i * m, &incr, u, &incr);
+            residual += (value - sigma * start[i]) * (value - sigma * start[i]);
+            norm += value * value;
+            start[i] = value;
+        }
+        norm = sqrt(norm);
+        for (i = 0; i < n; i++) start[i] /= norm;
+        if (sqrt(residual) <= tol * sigma) {
+            *info = 0;
+            // | A'u | is a better estimate than | A v |, and still a lower bound.
+            return norm;
+        }
+    }
+    for (i = 0; i < n; i++) start[i] = 0.0;
+    return 0.0;
+}
+
+// First canonical correlation of the (uncentered) n x dimX and n x dimY
+// column-major matrices qrX and qrY, through the QR decompositions of
+// both blocks and the SVD of Qx'Qy.  Both matrices are overwritten.
+// The caller guarantees nRow > dimX + dimY.  When ws -> tol > 0 the
+// leading singular value is found by power iteration from start, unless
+// start is NULL.
+static double ccaQRCorrelation(int           nRow,
+                               int           dimX,
+                               int           dimY,
+                               double       *qrX,
+                               double       *qrY,
+                               double       *start,
+                               CCAWorkspace *ws)
+{
+    char transa = 'T', transb = 'N';
+    char jobu = 'N', jobvt = 'N';
+    int ldu = 1, ldvt = 1;
+    double alpha = 1, beta = 0;
+    int info;
+    int lwork = ws -> lwork;
+    double ccaCor = 0.00;
+
+    int lda = nRow;
+    int Kx = dimX, Ky = dimY;
+
+    double *tauX = ws -> tauX;
+    double *tauY = ws -> tauY;
+    double *qMul = ws -> qMul;
+    double *S = ws -> S;
+    double *work = ws -> work;
+
+    info = 0;
+    F77_CALL(dgeqrf)(&nRow, &dimX, qrX, &lda, tauX, work, &lwork, &info);
+    F77_CALL(dorgqr)(&nRow, &Kx, &Kx, qrX, &lda, tauX, work, &lwork, &info);
+    F77_CALL(dgeqrf)(&nRow, &dimY, qrY, &lda, tauY, work, &lwork, &info);
+    F77_CALL(dorgqr)(&nRow, &Ky, &Ky, qrY, &lda, tauY, work, &lwork, &info);
+
+    F77_CALL(dgemm)(&transa, &transb, &Kx, &Ky, &nRow, &alpha, qrX, &nRow, qrY, &nRow, &beta, qMul, &Kx FCONE FCONE);
+
+    if ((ws -> tol > 0.0) && (start != NULL)) {
+        ccaCor = ccaPowerSingularValue(Kx, Ky, qMul, start, work, ws -> tol, &info);
+        if (info == 0) {
+            return ccaCor;
+        }
+    }
+
+    info = 0;
+    F77_CALL(dgesvd)(&jobu, &jobvt, &Kx, &Ky, qMul, &Kx, S, NULL, &ldu, NULL, &ldvt, work, &lwork, &info FCONE FCONE);
+
+    if (info == 0) {
+        ccaCor = S[0];
+    } else if (info > 0) {
+        CCA_PROFILE_ADD(ws, CCA_PROF_SVD_FAIL, 1);
+        ccaCor = S[0];
+        for (int i = 1; i < ws -> svdWork; i++) {
+            if (work[i] > ccaCor) {
+                ccaCor = work[i];
+            }
+        }
+    }
+
+    return ccaCor;
+}
+
 double ccaSplitAbsoluteDifference(unsigned int n,
                                   char        *membership,
                                   double      *time,
@@ -643,11 +998,6 @@ double ccaSplitAbsoluteDifference(unsigned int n,
     dimX = feature[featureCount][1];
     dimY = featureCount - dimX - 1;
     
-    int minDim = dimY;
-    if(dimX < dimY){
-        minDim = dimX;
-    }
-    
     if(dimX > 0 && dimY > 0){
         // Initialization of local variables:
         leftSize = rghtSize = 0;
@@ -658,203 +1008,626 @@ double ccaSplitAbsoluteDifference(unsigned int n,
         }
         
         if( (leftSize > (dimX+dimY)) && (rghtSize > (dimX+dimY)) ){
-            // Initializion of left and right X and Y datasets
-            double leftX[leftSize][dimX], leftY[leftSize][dimY];
-            double rightX[rghtSize][dimX], rightY[rghtSize][dimY];
+            // Column-major left and right X and Y, filled directly from
+            // the features into the buffers of the workspace of the
+            // calling thread.  A workspace of its own is only made when
+            // the rule is called from outside the growing of a forest.
+            CCAWorkspace *ws = getCCAWorkspace();
+            char ownFlag = (ws == NULL) || (ws -> size < n) || (ws -> dimX != (unsigned int) dimX) || (ws -> dimY != (unsigned int) dimY);
+            if (ownFlag) {
+                ws = ccaMakeWorkspace(n, dimX, dimY, 0.0);
+            }
+            double *leftX = ws -> left;
+            double *leftY = leftX + leftSize * dimX;
+            double *rightX = ws -> right;
+            double *rightY = rightX + rghtSize * dimX;
             
-            // Assignment of left and right X and Y
             for (i = 1; i <= n; i++) {
                 if(membership[i] == LEFT) {
-                    for(int col = 1; col <= dimX; col++){
-                        leftX[rowLeft][col-1] = feature[col][i];
+                    for(int col = 0; col < dimX; col++){
+                        leftX[rowLeft + col * leftSize] = feature[col+1][i];
                     }
-                    for(int col = (dimX+1); col <= (dimX+dimY); col++){
-                        leftY[rowLeft][col-dimX-1] = feature[col][i];
+                    for(int col = 0; col < dimY; col++){
+                        leftY[rowLeft + col * leftSize] = feature[dimX+col+1][i];
                     }
                     rowLeft++;
                 }
                 else{
-                    for(int col = 1; col <= dimX; col++){
-                        rightX[rowRight][col-1] = feature[col][i];
+                    for(int col = 0; col < dimX; col++){
+                        rightX[rowRight + col * rghtSize] = feature[col+1][i];
                     }
-                    for(int col = (dimX+1); col <= (dimX+dimY); col++){
-                        rightY[rowRight][col-dimX-1] = feature[col][i];
+                    for(int col = 0; col < dimY; col++){
+                        rightY[rowRight + col * rghtSize] = feature[dimX+col+1][i];
                     }
                     rowRight++;
                 }
             }
             
-            char transa = 'T', transb = 'N';
-            char jobu = 'N', jobvt = 'N';
-            int ldu = 1, ldvt = 1;
-            double alpha = 1, beta = 0;
-            int info, lwork;
-            
-            // CCA for left
-            int nRow = leftSize;
-            int lda = nRow;
-            int Kx = dimX, Ky = dimY;
-            if(nRow < dimX){Kx = nRow;}
-            if(nRow < dimY){Ky = nRow;}
+            // No warm starts: this rule is not seeded per node, and is
+            // solved by SVD whatever the tolerance of the workspace.
+            ccaCorLeft = ccaQRCorrelation(leftSize, dimX, dimY, leftX, leftY, NULL, ws);
+            ccaCorRight = ccaQRCorrelation(rghtSize, dimX, dimY, rightX, rightY, NULL, ws);
             
-            double *qrX = alloc_dvector(leftSize * dimX);
-            double *qrY = alloc_dvector(leftSize * dimY);
-            double *tauX = alloc_dvector(Kx);
-            double *tauY = alloc_dvector(Ky);
-            double *qMul = alloc_dvector(Kx * Ky);
-            double *S = alloc_dvector(minDim);
+            if (ownFlag) {
+                ccaFreeWorkspace(ws);
+            }
             
-            for(int row = 0; row < leftSize; row++){
-                for(int col = 0; col < dimX; col++){
-//                    qrX[row * dimX + col] = leftX[row][col];
-                    qrX[row + col * leftSize] = leftX[row][col];
-                }
-                for(int col = 0; col < dimY; col++){
-                    qrY[row + col * leftSize] = leftY[row][col];
-                }
+            ccaCor = sqrt((double) leftSize * (double) rghtSize) * fabs(ccaCorLeft - ccaCorRight);
+         }
+    }
+
+    return ccaCor;
+}
+
+/*
+  Bound on the CCA Split Statistic
+
+  Canonical correlations lie in [0, 1], so a split can never score more
+  than sqrt(nL * nR), and once the correlation rho of one daughter is
+  known, no more than sqrt(nL * nR) * max(rho, 1 - rho).  The split
+  rules below take a cutoff from the caller, the value a candidate has
+  to exceed to be of any use, and stop as soon as the bound shows that
+  it cannot, returning zero.  A negative cutoff disables the test.  The
+  bound is widened by CCA_BOUND_SLACK to cover rounding error in the
+  correlations, so a split that could win is never abandoned.
+*/
+
+static double ccaSplitBound(unsigned int leftSize,
+                            unsigned int rghtSize,
+                            double       rho)
+{
+    double bound = 1.0;
+
+    if (rho >= 0.0) {
+        bound = (rho > 1.0 - rho) ? rho : 1.0 - rho;
+    }
+    return sqrt((double) leftSize * (double) rghtSize) * (bound + CCA_BOUND_SLACK);
+}
+
+/*
+  CCA Split Rule on a Packed Node
+
+  Same statistic as ccaSplitAbsoluteDifference(), but the X and Y data
+  of the node are read from a column-major n x (dimX + dimY) buffer that
+  the caller packs once per candidate covariate, with the rows in the
+  same order as the membership vector.  This avoids gathering a feature
+  matrix for every split point.
+
+  membership - vector [1..n] of LEFT or RIGHT.
+  packed     - buffer with row i of the node in packed[(i-1) + col * ld].
+  cutoff     - see ccaSplitBound().
+  ws         - workspace of the calling thread, with ws -> size >= n.
+*/
+
+double ccaSplitPacked(unsigned int  n,
+                      char         *membership,
+                      double       *packed,
+                      unsigned int  ld,
+                      unsigned int  dimX,
+                      unsigned int  dimY,
+                      double        cutoff,
+                      CCAWorkspace *ws)
+{
+    double ccaCorLeft, ccaCorRight;
+    unsigned int leftSize = 0, rghtSize = 0;
+    unsigned int rowLeft = 0, rowRight = 0;
+    unsigned int i, col, dim;
+
+    dim = dimX + dimY;
+    for (i = 1; i <= n; i++) {
+        if (membership[i] == LEFT) {leftSize ++;}
+    }
+    rghtSize = n - leftSize;
+    if ((leftSize <= dim) || (rghtSize <= dim)) {
+        return 0.0;
+    }
+    CCA_PROFILE_ADD(ws, CCA_PROF_KERNEL, 1);
+    if (ccaSplitBound(leftSize, rghtSize, -1.0) <= cutoff) {
+        CCA_PROFILE_ADD(ws, CCA_PROF_PRUNED, 1);
+        return 0.0;
+    }
+
+    double *left = ws -> left;
+    double *right = ws -> right;
+
+    for (i = 1; i <= n; i++) {
+        if (membership[i] == LEFT) {
+            for (col = 0; col < dim; col++) {
+                left[rowLeft + col * leftSize] = packed[(i-1) + col * ld];
             }
+            rowLeft++;
+        }
+        else {
+            for (col = 0; col < dim; col++) {
+                right[rowRight + col * rghtSize] = packed[(i-1) + col * ld];
+            }
+            rowRight++;
+        }
+    }
 
-            double *work = NULL;
-            double work_query;
-            
-            info = 0, lwork = -1;
-            F77_CALL(dgeqrf)(&nRow, &dimX, qrX, &lda, tauX, &work_query, &lwork, &info);
-            lwork = (int)work_query;
-            work = (double*)malloc(sizeof(double) * lwork);
-//            double *work = (double *)malloc(lwork * sizeof(double));
-//            double *work = alloc_dvector(1);
-            F77_CALL(dgeqrf)(&nRow, &dimX, qrX, &lda, tauX, work, &lwork, &info);
-            free(work);
-            
-            info = 0, lwork = -1;
-            F77_CALL(dorgqr)(&nRow, &Kx, &Kx, qrX, &lda, tauX, &work_query, &lwork, &info);
-            lwork = (int)work_query;
-            work = (double*)malloc(sizeof(double) * lwork);
-            F77_CALL(dorgqr)(&nRow, &Kx, &Kx, qrX, &lda, tauX, work, &lwork, &info);
-            free(work);
-            
-            info = 0, lwork = -1;
-            F77_CALL(dgeqrf)(&nRow, &dimY, qrY, &lda, tauY, &work_query, &lwork, &info);
-            lwork = (int)work_query;
-            work = (double*)malloc(sizeof(double) * lwork);
-            F77_CALL(dgeqrf)(&nRow, &dimY, qrY, &lda, tauY, work, &lwork, &info);
-            free(work);
-            
-            info = 0, lwork = -1;
-            F77_CALL(dorgqr)(&nRow, &Ky, &Ky, qrY, &lda, tauY, &work_query, &lwork, &info);
-            lwork = (int)work_query;
-            work = (double*)malloc(sizeof(double) * lwork);
-            F77_CALL(dorgqr)(&nRow, &Ky, &Ky, qrY, &lda, tauY, work, &lwork, &info);
-            free(work);
-            
-            F77_CALL(dgemm)(&transa, &transb, &Kx, &Ky, &nRow, &alpha, qrX, &nRow, qrY, &nRow, &beta, qMul, &Kx FCONE FCONE);
-            
-            info = 0, lwork = -1;
-            F77_CALL(dgesvd)(&jobu, &jobvt, &Kx, &Ky, qMul, &Kx, S, NULL, &ldu, NULL, &ldvt, &work_query, &lwork, &info FCONE FCONE);
-            lwork = (int)work_query;
-            work = (double*)malloc(sizeof(double) * lwork);
-            F77_CALL(dgesvd)(&jobu, &jobvt, &Kx, &Ky, qMul, &Kx, S, NULL, &ldu, NULL, &ldvt, work, &lwork, &info FCONE FCONE);
-            
-            if (info == 0) {
-                ccaCorLeft = S[0];
-            } else if (info > 0) {
-                ccaCorLeft = S[0];
-                for (int i = 1; i < lwork; i++) {
-                    if (work[i] > ccaCorLeft) {
-                        ccaCorLeft = work[i];
-                    }
+    // The X columns come first, so each daughter is a pair of
+    // contiguous column-major blocks.
+    ccaCorLeft = ccaQRCorrelation(leftSize, dimX, dimY, left, left + leftSize * dimX, ws -> qrLeftStart, ws);
+    if (ccaSplitBound(leftSize, rghtSize, ccaCorLeft) <= cutoff) {
+        CCA_PROFILE_ADD(ws, CCA_PROF_PRUNED, 1);
+        return 0.0;
+    }
+    ccaCorRight = ccaQRCorrelation(rghtSize, dimX, dimY, right, right + rghtSize * dimX, ws -> qrRightStart, ws);
+
+    return sqrt((double) leftSize * (double) rghtSize) * fabs(ccaCorLeft - ccaCorRight);
+}
+
+/*
+  Incremental CCA Split Rule
+
+  For continuous split points the members of a node arrive sorted by
+  the split covariate, and consecutive split points only move a few
+  members from the right daughter to the left daughter.  Instead of
+  refactoring both daughters from scratch for every split point, the
+  caller keeps the (uncentered) cross-product matrix
+
+      G = [X Y]' [X Y] = | Sxx  Sxy |
+                         | Syx  Syy |
+
+  of the left daughter and of the parent node, and moves the rows that
+  change sides with ccaUpdateCrossProduct().  The split statistic is
+  then recovered from these (dimX+dimY) x (dimX+dimY) matrices alone.
+
+  Since Sxx = Rx'Rx for the R factor of the QR decomposition of X, the
+  Cholesky factors Lx and Ly of Sxx and Syy give Qx'Qy = Lx^-1 Sxy Ly^-T,
+  so the first singular value of this matrix is exactly the quantity
+  computed by ccaSplitAbsoluteDifference().
+
+  The cross-product matrices are stored column-major in the lower
+  triangle of a dim x dim array, dim = dimX + dimY.  Only the lower
+  triangle is ever referenced.
+*/
+
+// Engine used to evaluate the splits of a node of size n.  The QR engine
+// costs O(n p^2) per split point and the Cholesky engine O(p^3) once the
+// cross-product matrices are known, with p = dimX + dimY.  The QR engine
+// is kept for small nodes, where the daughters are close to singular and
+// the Cholesky engine would mostly fall back to it anyway.
+unsigned int ccaSelectEngine(unsigned int engine,
+                             unsigned int n,
+                             unsigned int dimX,
+                             unsigned int dimY)
+{
+    if (engine == CCA_ENGINE_AUTO) {
+        if (n >= CCA_CHOL_RATIO * (dimX + dimY)) {
+            return CCA_ENGINE_CHOL;
+        }
+        return CCA_ENGINE_QR;
+    }
+    return engine;
+}
+
+// Add (weight = 1) or remove (weight = -1) one observation to the
+// cross-product matrix.  Element col of the observation is row[col * stride].
+void ccaUpdateCrossProduct(double       *gram,
+                           unsigned int  dim,
+                           double       *row,
+                           unsigned int  stride,
+                           double        weight)
+{
+    unsigned int i, j;
+    double value;
+
+    for (j = 0; j < dim; j++) {
+        value = weight * row[j * stride];
+        for (i = j; i < dim; i++) {
+            gram[i + j * dim] += value * row[i * stride];
+        }
+    }
+}
+
+// Size of the scratch space needed by ccaCrossProductCorrelation().
+unsigned int ccaCrossProductWorkSize(unsigned int dimX, unsigned int dimY)
+{
+    unsigned int minDim = (dimX < dimY) ? dimX : dimY;
+    unsigned int maxDim = (dimX < dimY) ? dimY : dimX;
+    unsigned int lwork = 3 * minDim + maxDim;
+
+    if (lwork < 5 * minDim) {
+        lwork = 5 * minDim;
+    }
+    return (dimX * dimX) + (dimY * dimY) + (dimX * dimY) + minDim + lwork;
+}
+
+// First canonical correlation from a cross-product matrix.  A non-zero
+// info is returned when a Cholesky factor is singular or too badly
+// conditioned to be trusted, or when the SVD does not converge.  The
+// caller must then fall back to the QR based computation.  When tol > 0
+// the leading singular value is found by power iteration from start, a
+// vector of length dimX.
+double ccaCrossProductCorrelation(double       *gram,
+                                  unsigned int  dimX,
+                                  unsigned int  dimY,
+                                  double       *work,
+                                  double        tol,
+                                  double       *start,
+                                  int          *info)
+{
+    char lower = 'L', left = 'L', right = 'R', noTrans = 'N', trans = 'T', nonUnit = 'N';
+    char jobu = 'N', jobvt = 'N';
+    int ldu = 1, ldvt = 1;
+    int px = dimX, py = dimY;
+    int minDim = (px < py) ? px : py;
+    int lwork;
+    double alpha = 1.0;
+    double diagMin, diagMax, sigma;
+    unsigned int dim = dimX + dimY;
+    unsigned int i, j;
+
+    double *Lx = work;
+    double *Ly = Lx + dimX * dimX;
+    double *C  = Ly + dimY * dimY;
+    double *S  = C + dimX * dimY;
+    double *svdWork = S + minDim;
+    lwork = ccaCrossProductWorkSize(dimX, dimY) - (dimX * dimX) - (dimY * dimY) - (dimX * dimY) - minDim;
+
+    // Copy Sxx, Syy and Syx out of the lower triangle.
+    for (j = 0; j < dimX; j++) {
+        for (i = j; i < dimX; i++) {
+            Lx[i + j * dimX] = gram[i + j * dim];
+        }
+        for (i = 0; i < dimY; i++) {
+            C[i + j * dimY] = gram[(dimX + i) + j * dim];
+        }
+    }
+    for (j = 0; j < dimY; j++) {
+        for (i = j; i < dimY; i++) {
+            Ly[i + j * dimY] = gram[(dimX + i) + (dimX + j) * dim];
+        }
+    }
+
+    *info = 0;
+    F77_CALL(dpotrf)(&lower, &px, Lx, &px, info FCONE);
+    if (*info != 0) return 0.0;
+    F77_CALL(dpotrf)(&lower, &py, Ly, &py, info FCONE);
+    if (*info != 0) return 0.0;
+
+    // The QR route is insensitive to collinearity in the daughter, the
+    // Cholesky route is not.  Bail out when either factor is close to
+    // singular.
+    diagMin = diagMax = fabs(Lx[0]);
+    for (i = 1; i < dimX; i++) {
+        if (fabs(Lx[i + i * dimX]) < diagMin) diagMin = fabs(Lx[i + i * dimX]);
+        if (fabs(Lx[i + i * dimX]) > diagMax) diagMax = fabs(Lx[i + i * dimX]);
+    }
+    if (diagMin <= CCA_CHOL_TOL * diagMax) {
+        *info = 1;
+        return 0.0;
+    }
+    diagMin = diagMax = fabs(Ly[0]);
+    for (i = 1; i < dimY; i++) {
+        if (fabs(Ly[i + i * dimY]) < diagMin) diagMin = fabs(Ly[i + i * dimY]);
+        if (fabs(Ly[i + i * dimY]) > diagMax) diagMax = fabs(Ly[i + i * dimY]);
+    }
+    if (diagMin <= CCA_CHOL_TOL * diagMax) {
+        *info = 1;
+        return 0.0;
+    }
+
+    // C = Ly^-1 Syx Lx^-T, the transpose of Qx'Qy.
+    F77_CALL(dtrsm)(&left, &lower, &noTrans, &nonUnit, &py, &px, &alpha, Ly, &py, C, &py FCONE FCONE FCONE FCONE);
+    F77_CALL(dtrsm)(&right, &lower, &trans, &nonUnit, &py, &px, &alpha, Lx, &px, C, &py FCONE FCONE FCONE FCONE);
+
+    if (tol > 0.0) {
+        sigma = ccaPowerSingularValue(py, px, C, start, svdWork, tol, info);
+        if (*info == 0) return sigma;
+    }
+
+    F77_CALL(dgesvd)(&jobu, &jobvt, &py, &px, C, &py, S, NULL, &ldu, NULL, &ldvt, svdWork, &lwork, info FCONE FCONE);
+    if (*info != 0) return 0.0;
+
+    return S[0];
+}
+
+/*
+  Small-Dimension CCA Kernels
+
+  With dimX and dimY both at most CCA_SMALL_DIM the matrices handled by
+  ccaCrossProductCorrelation() are tiny, and the LAPACK calls cost far
+  more than the arithmetic they do.  For these dimensions the same
+  quantity is computed by kernels generated for each (dimX, dimY) pair,
+  so that all loop bounds are compile-time constants the compiler can
+  unroll and vectorize: an unrolled Cholesky factorization of Sxx and
+  Syy, two triangular solves for C = Ly^-1 Syx Lx^-T, and the largest
+  eigenvalue of the smaller of C'C and CC', in closed form up to order
+  two and by cyclic Jacobi rotations above.  The kernels apply the same
+  conditioning test as the LAPACK route and report it through info.
+
+  The cross-product updates are generated the same way for every
+  dim = dimX + dimY up to 2 * CCA_SMALL_DIM, and give the same result
+  as ccaUpdateCrossProduct().
+
+  The kernels of a forest are looked up once, in ccaMakeWorkspace(),
+  from dispatch tables indexed by the dimensions.  A null entry in the
+  workspace means that LAPACK is used.
+*/
+
+#if defined(__GNUC__)
+#define CCA_INLINE static inline __attribute__((always_inline))
+#else
+#define CCA_INLINE static inline
+#endif
+
+CCA_INLINE void ccaSmallUpdate(double       *gram,
+                               unsigned int  dim,
+                               double       *row,
+                               unsigned int  stride,
+                               double        weight)
+{
+    unsigned int i, j;
+    double value[2 * CCA_SMALL_DIM];
+
+    for (j = 0; j < dim; j++) {
+        value[j] = row[j * stride];
+    }
+    for (j = 0; j < dim; j++) {
+        for (i = j; i < dim; i++) {
+            gram[i + j * dim] += (weight * value[j]) * value[i];
+        }
+    }
+}
+
+// Lower Cholesky factor of the p x p matrix a in place.  Returns
+// non-zero when a is not positive definite.
+CCA_INLINE int ccaSmallCholesky(double *a, int p)
+{
+    int i, j, k;
+    double d, s;
+
+    for (j = 0; j < p; j++) {
+        d = a[j + j * p];
+        for (k = 0; k < j; k++) d -= a[j + k * p] * a[j + k * p];
+        if (!(d > 0.0)) return 1;
+        d = sqrt(d);
+        a[j + j * p] = d;
+        for (i = j + 1; i < p; i++) {
+            s = a[i + j * p];
+            for (k = 0; k < j; k++) s -= a[i + k * p] * a[j + k * p];
+            a[i + j * p] = s / d;
+        }
+    }
+    return 0;
+}
+
+// Same test as ccaCrossProductCorrelation() on the diagonal of a factor.
+CCA_INLINE int ccaSmallConditioned(double *a, int p)
+{
+    int i;
+    double diagMin, diagMax;
+
+    diagMin = diagMax = a[0];
+    for (i = 1; i < p; i++) {
+        if (a[i + i * p] < diagMin) diagMin = a[i + i * p];
+        if (a[i + i * p] > diagMax) diagMax = a[i + i * p];
+    }
+    return (diagMin > CCA_CHOL_TOL * diagMax);
+}
+
+// Largest eigenvalue of the symmetric k x k matrix m, which is destroyed.
+CCA_INLINE double ccaSmallEigenMax(double *m, int k)
+{
+    int p, q, r, sweep;
+    double off, norm, apq, theta, t, c, s, mrp, mrq, value;
+
+    if (k == 1) {
+        return m[0];
+    }
+    if (k == 2) {
+        return 0.5 * (m[0] + m[3]) + hypot(0.5 * (m[0] - m[3]), m[1]);
+    }
+    for (sweep = 0; sweep < CCA_JACOBI_MAXSWEEP; sweep++) {
+        off = norm = 0.0;
+        for (q = 0; q < k; q++) {
+            norm += m[q + q * k] * m[q + q * k];
+            for (p = 0; p < q; p++) off += m[p + q * k] * m[p + q * k];
+        }
+        if (off <= DBL_EPSILON * DBL_EPSILON * norm) break;
+        for (p = 0; p < k - 1; p++) {
+            for (q = p + 1; q < k; q++) {
+                apq = m[p + q * k];
+                if (apq == 0.0) continue;
+                theta = (m[q + q * k] - m[p + p * k]) / (2.0 * apq);
+                t = 1.0 / (fabs(theta) + sqrt(theta * theta + 1.0));
+                if (theta < 0.0) t = -t;
+                c = 1.0 / sqrt(t * t + 1.0);
+                s = t * c;
+                for (r = 0; r < k; r++) {
+                    if ((r == p) || (r == q)) continue;
+                    mrp = m[r + p * k];
+                    mrq = m[r + q * k];
+                    m[r + p * k] = m[p + r * k] = c * mrp - s * mrq;
+                    m[r + q * k] = m[q + r * k] = s * mrp + c * mrq;
                 }
+                m[p + p * k] -= t * apq;
+                m[q + q * k] += t * apq;
+                m[p + q * k] = m[q + p * k] = 0.0;
             }
-            free(work);
-            
-            dealloc_dvector(qrX);
-            dealloc_dvector(qrY);
-            dealloc_dvector(qMul);
-            dealloc_dvector(tauX);
-            dealloc_dvector(tauY);
-            
-            // CCA for right
-            nRow = rghtSize;
-            lda = nRow;
-            Kx = dimX, Ky = dimY;
-            if(nRow < dimX){Kx = nRow;}
-            if(nRow < dimY){Ky = nRow;}
-            
-            qrX = alloc_dvector(rghtSize * dimX);
-            qrY = alloc_dvector(rghtSize * dimY);
-            tauX = alloc_dvector(Kx);
-            tauY = alloc_dvector(Ky);
-            qMul = alloc_dvector(Kx * Ky);
-            
-            for(int row = 0; row < rghtSize; row++){
-                for(int col = 0; col < dimX; col++){
-                    qrX[row + col * rghtSize] = rightX[row][col];
-                }
-                for(int col = 0; col < dimY; col++){
-                    qrY[row + col * rghtSize] = rightY[row][col];
-                }
+        }
+    }
+    value = m[0];
+    for (p = 1; p < k; p++) {
+        if (m[p + p * k] > value) value = m[p + p * k];
+    }
+    return value;
+}
+
+CCA_INLINE double ccaSmallCorrelation(double *gram, int px, int py, int *info)
+{
+    int dim = px + py;
+    int minDim = (px < py) ? px : py;
+    int i, j, k;
+    double Lx[CCA_SMALL_DIM * CCA_SMALL_DIM];
+    double Ly[CCA_SMALL_DIM * CCA_SMALL_DIM];
+    double C[CCA_SMALL_DIM * CCA_SMALL_DIM];
+    double M[CCA_SMALL_DIM * CCA_SMALL_DIM];
+    double s, lambda;
+
+    for (j = 0; j < px; j++) {
+        for (i = j; i < px; i++) {
+            Lx[i + j * px] = gram[i + j * dim];
+        }
+        for (i = 0; i < py; i++) {
+            C[i + j * py] = gram[(px + i) + j * dim];
+        }
+    }
+    for (j = 0; j < py; j++) {
+        for (i = j; i < py; i++) {
+            Ly[i + j * py] = gram[(px + i) + (px + j) * dim];
+        }
+    }
+
+    *info = 1;
+    if (ccaSmallCholesky(Lx, px) || ccaSmallCholesky(Ly, py)) return 0.0;
+    if (!ccaSmallConditioned(Lx, px) || !ccaSmallConditioned(Ly, py)) return 0.0;
+    *info = 0;
+
+    // C = Ly^-1 Syx, one column at a time ...
+    for (j = 0; j < px; j++) {
+        for (i = 0; i < py; i++) {
+            s = C[i + j * py];
+            for (k = 0; k < i; k++) s -= Ly[i + k * py] * C[k + j * py];
+            C[i + j * py] = s / Ly[i + i * py];
+        }
+    }
+    // ... and C = C Lx^-T, one row at a time.
+    for (i = 0; i < py; i++) {
+        for (j = 0; j < px; j++) {
+            s = C[i + j * py];
+            for (k = 0; k < j; k++) s -= Lx[j + k * px] * C[i + k * py];
+            C[i + j * py] = s / Lx[j + j * px];
+        }
+    }
+
+    // The squared singular values of C are the eigenvalues of C'C and CC'.
+    if (px <= py) {
+        for (j = 0; j < px; j++) {
+            for (i = j; i < px; i++) {
+                s = 0.0;
+                for (k = 0; k < py; k++) s += C[k + i * py] * C[k + j * py];
+                M[i + j * px] = M[j + i * px] = s;
             }
-            
-            info = 0, lwork = -1;
-            F77_CALL(dgeqrf)(&nRow, &dimX, qrX, &lda, tauX, &work_query, &lwork, &info);
-            lwork = (int)work_query;
-            work = (double*)malloc(sizeof(double) * lwork);
-            F77_CALL(dgeqrf)(&nRow, &dimX, qrX, &lda, tauX, work, &lwork, &info);
-            free(work);
-            
-            info = 0, lwork = -1;
-            F77_CALL(dorgqr)(&nRow, &Kx, &Kx, qrX, &lda, tauX, &work_query, &lwork, &info);
-            lwork = (int)work_query;
-            work = (double*)malloc(sizeof(double) * lwork);
-            F77_CALL(dorgqr)(&nRow, &Kx, &Kx, qrX, &lda, tauX, work, &lwork, &info);
-            free(work);
-            
-            info = 0, lwork = -1;
-            F77_CALL(dgeqrf)(&nRow, &dimY, qrY, &lda, tauY, &work_query, &lwork, &info);
-            lwork = (int)work_query;
-            work = (double*)malloc(sizeof(double) * lwork);
-            F77_CALL(dgeqrf)(&nRow, &dimY, qrY, &lda, tauY, work, &lwork, &info);
-            free(work);
-            
-            info = 0, lwork = -1;
-            F77_CALL(dorgqr)(&nRow, &Ky, &Ky, qrY, &lda, tauY, &work_query, &lwork, &info);
-            lwork = (int)work_query;
-            work = (double*)malloc(sizeof(double) * lwork);
-            F77_CALL(dorgqr)(&nRow, &Ky, &Ky, qrY, &lda, tauY, work, &lwork, &info);
-            free(work);
-            
-            F77_CALL(dgemm)(&transa, &transb, &Kx, &Ky, &nRow, &alpha, qrX, &nRow, qrY, &nRow, &beta, qMul, &Kx FCONE FCONE);
-            
-            info = 0, lwork = -1;
-            F77_CALL(dgesvd)(&jobu, &jobvt, &Kx, &Ky, qMul, &Kx, S, NULL, &ldu, NULL, &ldvt, &work_query, &lwork, &info FCONE FCONE);
-            lwork = (int)work_query;
-            work = (double*)malloc(sizeof(double) * lwork);
-            F77_CALL(dgesvd)(&jobu, &jobvt, &Kx, &Ky, qMul, &Kx, S, NULL, &ldu, NULL, &ldvt, work, &lwork, &info FCONE FCONE);
-            
-            if (info == 0) {
-                ccaCorRight = S[0];
-            } else if (info > 0) {
-                ccaCorRight = S[0];
-                for (int i = 1; i < lwork; i++) {
-                    if (work[i] > ccaCorRight) {
-                        ccaCorRight = work[i];
-                    }
-                }
+        }
+    }
+    else {
+        for (j = 0; j < py; j++) {
+            for (i = j; i < py; i++) {
+                s = 0.0;
+                for (k = 0; k < px; k++) s += C[i + k * py] * C[j + k * py];
+                M[i + j * py] = M[j + i * py] = s;
             }
-            free(work);
-         
-            dealloc_dvector(qrX);
-            dealloc_dvector(qrY);
-            dealloc_dvector(qMul);
-            dealloc_dvector(tauX);
-            dealloc_dvector(tauY);
-            dealloc_dvector(S);
-            
-            ccaCor = sqrt(leftSize * rghtSize) * fabs(ccaCorLeft - ccaCorRight);
-         }
+        }
     }
+    lambda = ccaSmallEigenMax(M, minDim);
 
-    return ccaCor;
+    return (lambda > 0.0) ? sqrt(lambda) : 0.0;
+}
+
+#define CCA_SMALL_UPDATE(D)                                             \
+    static void ccaSmallUpdate##D(double *gram, unsigned int dim, double *row, unsigned int stride, double weight) \
+    {                                                                   \
+        ccaSmallUpdate(gram, D, row, stride, weight);                   \
+    }
+
+#define CCA_SMALL_CORRELATION(PX, PY)                                   \
+    static double ccaSmallCorrelation##PX##PY(double *gram, int *info)  \
+    {                                                                   \
+        return ccaSmallCorrelation(gram, PX, PY, info);                 \
+    }
+
+CCA_SMALL_UPDATE(2) CCA_SMALL_UPDATE(3) CCA_SMALL_UPDATE(4) CCA_SMALL_UPDATE(5)
+CCA_SMALL_UPDATE(6) CCA_SMALL_UPDATE(7) CCA_SMALL_UPDATE(8)
+
+CCA_SMALL_CORRELATION(1, 1) CCA_SMALL_CORRELATION(1, 2) CCA_SMALL_CORRELATION(1, 3) CCA_SMALL_CORRELATION(1, 4)
+CCA_SMALL_CORRELATION(2, 1) CCA_SMALL_CORRELATION(2, 2) CCA_SMALL_CORRELATION(2, 3) CCA_SMALL_CORRELATION(2, 4)
+CCA_SMALL_CORRELATION(3, 1) CCA_SMALL_CORRELATION(3, 2) CCA_SMALL_CORRELATION(3, 3) CCA_SMALL_CORRELATION(3, 4)
+CCA_SMALL_CORRELATION(4, 1) CCA_SMALL_CORRELATION(4, 2) CCA_SMALL_CORRELATION(4, 3) CCA_SMALL_CORRELATION(4, 4)
+
+// Indexed by dim - 2.
+static const CCAUpdateKernel ccaSmallUpdateTable[2 * CCA_SMALL_DIM - 1] = {
+    ccaSmallUpdate2, ccaSmallUpdate3, ccaSmallUpdate4, ccaSmallUpdate5,
+    ccaSmallUpdate6, ccaSmallUpdate7, ccaSmallUpdate8
+};
+
+// Indexed by dimX - 1 and dimY - 1.
+static const CCACorrelationKernel ccaSmallCorrelationTable[CCA_SMALL_DIM][CCA_SMALL_DIM] = {
+    {ccaSmallCorrelation11, ccaSmallCorrelation12, ccaSmallCorrelation13, ccaSmallCorrelation14},
+    {ccaSmallCorrelation21, ccaSmallCorrelation22, ccaSmallCorrelation23, ccaSmallCorrelation24},
+    {ccaSmallCorrelation31, ccaSmallCorrelation32, ccaSmallCorrelation33, ccaSmallCorrelation34},
+    {ccaSmallCorrelation41, ccaSmallCorrelation42, ccaSmallCorrelation43, ccaSmallCorrelation44}
+};
+
+static void ccaSelectKernels(CCAWorkspace *ws)
+{
+    unsigned int dim = ws -> dimX + ws -> dimY;
+
+    ws -> update = ccaUpdateCrossProduct;
+    ws -> correlation = NULL;
+    if ((ws -> dimX <= CCA_SMALL_DIM) && (ws -> dimY <= CCA_SMALL_DIM)) {
+        ws -> update = ccaSmallUpdateTable[dim - 2];
+        ws -> correlation = ccaSmallCorrelationTable[ws -> dimX - 1][ws -> dimY - 1];
+    }
+}
+
+// Split statistic of ccaSplitAbsoluteDifference() from the cross-product
+// matrices of the left daughter and of the parent, using the scratch
+// space and the kernels of the workspace ws.  See ccaSplitBound() for
+// the cutoff.
+double ccaSweepSplitStatistic(unsigned int  leftSize,
+                              unsigned int  totalSize,
+                              double       *leftGram,
+                              double       *totalGram,
+                              unsigned int  dimX,
+                              unsigned int  dimY,
+                              double        cutoff,
+                              CCAWorkspace *ws,
+                              int          *info)
+{
+    unsigned int dim = dimX + dimY;
+    unsigned int rghtSize = totalSize - leftSize;
+    unsigned int i, j;
+    double ccaCorLeft, ccaCorRight;
+    double *work = ws -> sweepWork;
+    double *rightGram = work;
+
+    *info = 0;
+    if ((leftSize <= dim) || (rghtSize <= dim)) {
+        return 0.0;
+    }
+    CCA_PROFILE_ADD(ws, CCA_PROF_KERNEL, 1);
+    if (ccaSplitBound(leftSize, rghtSize, -1.0) <= cutoff) {
+        CCA_PROFILE_ADD(ws, CCA_PROF_PRUNED, 1);
+        return 0.0;
+    }
+    if (ws -> correlation != NULL) {
+        ccaCorLeft = ws -> correlation(leftGram, info);
+    }
+    else {
+        ccaCorLeft = ccaCrossProductCorrelation(leftGram, dimX, dimY, work + dim * dim, ws -> tol, ws -> cholLeftStart, info);
+    }
+    if (*info != 0) return 0.0;
+    if (ccaSplitBound(leftSize, rghtSize, ccaCorLeft) <= cutoff) {
+        CCA_PROFILE_ADD(ws, CCA_PROF_PRUNED, 1);
+        return 0.0;
+    }
+    for (j = 0; j < dim; j++) {
+        for (i = j; i < dim; i++) {
+            rightGram[i + j * dim] = totalGram[i + j * dim] - leftGram[i + j * dim];
+        }
+    }
+    if (ws -> correlation != NULL) {
+        ccaCorRight = ws -> correlation(rightGram, info);
+    }
+    else {
+        ccaCorRight = ccaCrossProductCorrelation(rightGram, dimX, dimY, work + dim * dim, ws -> tol, ws -> cholRightStart, info);
+    }
+    if (*info != 0) return 0.0;
+
+    return sqrt((double) leftSize * (double) rghtSize) * fabs(ccaCorLeft - ccaCorRight);
 }
 
 /*
@@ -142,6 +142,187 @@ double ccaSplitAbsoluteDifference (unsigned int n,
                                    double     **feature,
                                    unsigned int featureCount);
 
+// Kernels of the CCA split rule, specialised for small dimensions.
+typedef void   (*CCAUpdateKernel)(double *gram, unsigned int dim, double *row, unsigned int stride, double weight);
+typedef double (*CCACorrelationKernel)(double *gram, int *info);
+
+// Counters and phase timers of the CCA split search, kept per thread
+// when the forest is grown with profiling on.  The times are seconds.
+#define CCA_PROF_NODES     0
+#define CCA_PROF_COVARIATE 1
+#define CCA_PROF_ROWS      2
+#define CCA_PROF_KERNEL    3
+#define CCA_PROF_WRAPPER   4
+#define CCA_PROF_PRUNED    5
+#define CCA_PROF_FALLBACK  6
+#define CCA_PROF_SVD_FAIL  7
+#define CCA_PROF_TREE      8
+#define CCA_PROF_SORT      9
+#define CCA_PROF_GATHER   10
+#define CCA_PROF_SPLIT    11
+#define CCA_PROF_NODE     12
+#define CCA_PROF_CNT      13
+
+// Blocks of the arena of a workspace, and a position in the arena to
+// release its vectors back to.
+typedef struct ccaArenaBlock CCAArenaBlock;
+struct ccaArenaBlock {
+  CCAArenaBlock *next;
+  size_t         size;
+  size_t         used;
+  double         data[];
+};
+
+typedef struct ccaArenaMark {
+  CCAArenaBlock *block;
+  size_t         used;
+} CCAArenaMark;
+
+// Bytes of the first arena block per row of the workspace, and the
+// bytes it has on top of these.
+#define CCA_ARENA_ROW   (3 * sizeof(double) + 3 * sizeof(char))
+#define CCA_ARENA_SLACK 4096
+
+// Per-thread scratch space of the CCA split rule.  The buffers hold
+// up to size rows of the dimX + dimY packed node variables.
+typedef struct ccaWorkspace CCAWorkspace;
+struct ccaWorkspace {
+  unsigned int size;
+  unsigned int dimX;
+  unsigned int dimY;
+
+  double *packed;
+  double *left;
+  double *right;
+
+  double *nodeGram;
+  double *leftGram;
+  double *sweepWork;
+
+  double *tauX;
+  double *tauY;
+  double *qMul;
+  double *S;
+  double *work;
+  int     lwork;
+  int     svdWork;
+
+  // Tolerance of the power iteration for the leading singular value
+  // (zero for a full SVD), and its warm starts for each daughter, kept
+  // apart for the Cholesky (length dimX) and QR (length dimY) engines.
+  // start holds both daughters, each as [Cholesky | QR], so that a
+  // daughter's half is the seed of the search in that daughter.
+  double  tol;
+  double *start;
+  double *cholLeftStart;
+  double *cholRightStart;
+  double *qrLeftStart;
+  double *qrRightStart;
+  // Cross-product update and, for small dimensions, the correlation
+  // kernel used in place of ccaCrossProductCorrelation().
+  CCAUpdateKernel      update;
+  CCACorrelationKernel correlation;
+  // Profile of the searches made in this workspace, only kept when
+  // profiling is set.
+  char    profiling;
+  double  profile[CCA_PROF_CNT];
+  // Arena of the scratch vectors of the split search of a tree, and
+  // its block in use.
+  CCAArenaBlock *arena;
+  CCAArenaBlock *arenaTop;
+};
+
+#define CCA_PROFILE_ADD(ws, k, v) do { if ((ws) -> profiling) (ws) -> profile[k] += (v); } while (0)
+
+
+CCAWorkspace *ccaMakeWorkspace(unsigned int size,
+                               unsigned int dimX,
+                               unsigned int dimY,
+                               double       tol);
+void          ccaFreeWorkspace(CCAWorkspace *ws);
+// Workspace of the calling thread, defined with the forest in
+// randomForestSRC.c, and NULL outside the growing of a forest.
+CCAWorkspace *getCCAWorkspace(void);
+double        ccaProfileClock(void);
+
+void         *ccaArenaAlloc(CCAWorkspace *ws, size_t bytes);
+CCAArenaMark  ccaArenaSave(CCAWorkspace *ws);
+void          ccaArenaRelease(CCAWorkspace *ws, CCAArenaMark mark);
+void          ccaArenaReset(CCAWorkspace *ws);
+
+void          ccaSeedStart(CCAWorkspace *ws, double *seed);
+void          ccaSaveStart(CCAWorkspace *ws, double *dest);
+
+double ccaSplitPacked(unsigned int  n,
+                      char         *membership,
+                      double       *packed,
+                      unsigned int  ld,
+                      unsigned int  dimX,
+                      unsigned int  dimY,
+                      double        cutoff,
+                      CCAWorkspace *ws);
+
+// Smallest ratio of Cholesky diagonals accepted before falling back to QR.
+#define CCA_CHOL_TOL 1.0e-6
+
+// Engines of the CCA split rule.  With CCA_ENGINE_AUTO the Cholesky
+// engine is used for nodes with at least CCA_CHOL_RATIO members per
+// X and Y variable.
+#define CCA_ENGINE_AUTO 0
+#define CCA_ENGINE_QR   1
+#define CCA_ENGINE_CHOL 2
+#define CCA_CHOL_RATIO  4
+
+// With node threads, the split points of a continuous covariate are
+// shared between them for nodes of at least CCA_NODE_MIN members, in
+// CCA_NODE_CHUNKS chunks per thread.
+#define CCA_NODE_MIN    512
+#define CCA_NODE_CHUNKS 4
+
+// Relative widening of the bound used to abandon candidate splits.
+#define CCA_BOUND_SLACK 1.0e-6
+
+// Largest number of power iterations before falling back to the SVD.
+#define CCA_POWER_MAXITER 100
+
+// Largest dimX and dimY with kernels of their own, and the largest
+// number of Jacobi sweeps these make.
+#define CCA_SMALL_DIM       4
+#define CCA_JACOBI_MAXSWEEP 16
+
+unsigned int ccaSelectEngine(unsigned int engine,
+                             unsigned int n,
+                             unsigned int dimX,
+                             unsigned int dimY);
+
+void ccaUpdateCrossProduct(double       *gram,
+                           unsigned int  dim,
+                           double       *row,
+                           unsigned int  stride,
+                           double        weight);
+
+unsigned int ccaCrossProductWorkSize(unsigned int dimX, unsigned int dimY);
+
+double ccaCrossProductCorrelation(double       *gram,
+                                  unsigned int  dimX,
+                                  unsigned int  dimY,
+                                  double       *work,
+                                  double        tol,
+                                  double       *start,
+                                  int          *info);
+
+// Incremental form of ccaSplitAbsoluteDifference() working on the
+// cross-product matrices of the daughters.
+double ccaSweepSplitStatistic(unsigned int  leftSize,
+                              unsigned int  totalSize,
+                              double       *leftGram,
+                              double       *totalGram,
+                              unsigned int  dimX,
+                              unsigned int  dimY,
+                              double        cutoff,
+                              CCAWorkspace *ws,
+                              int          *info);
+
 unsigned int *alloc_uivector(unsigned int nh);
 void          dealloc_uivector(unsigned int *v, unsigned int nh);
 